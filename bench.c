@@ -0,0 +1,373 @@
+#define _GNU_SOURCE
+#include "builtins.h"
+#include "exec.h"
+#include "eval.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+// bench [-n runs] [-w warmup] [-i] [--show-output] [--prepare cmd... --]
+//       [--csv file] [--json file] cmd... [--vs cmd...]
+// runs cmd through the normal launch path and reports wall/user/sys statistics
+
+#define OUTLIER_Z 3.5   // modified z-score above which a run counts as an outlier
+
+struct stats {
+    double mean, stddev, min, p50, p95, max;
+};
+
+struct target {
+    char **argv;        // points into bench's copy of argv, cut off with NULL
+    double *wall, *user, *sys;  // per timed run, ms
+    int runs;
+    struct stats s_wall, s_user, s_sys;
+    int outliers;
+};
+
+struct bench_opts {
+    int runs;
+    int warmup;
+    int ignore_failure;
+    int quiet;
+    char **prepare;
+    const char *csv;
+    const char *json;
+};
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// linear interpolation between the closest ranks of a sorted array
+static double percentile(const double *sorted, int n, double p) {
+    if (n == 1) return sorted[0];
+    double rank = p * (n - 1);
+    int lo = (int)rank;
+    if (lo >= n - 1) return sorted[n - 1];
+    return sorted[lo] + (rank - lo) * (sorted[lo + 1] - sorted[lo]);
+}
+
+static struct stats summarize(const double *v, int n) {
+    struct stats s = {0};
+    double *sorted = malloc(n * sizeof(double));
+    if (!sorted) return s;
+    memcpy(sorted, v, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), cmp_double);
+
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += v[i];
+    s.mean = sum / n;
+    double sq = 0;
+    for (int i = 0; i < n; i++) sq += (v[i] - s.mean) * (v[i] - s.mean);
+    s.stddev = n > 1 ? sqrt(sq / (n - 1)) : 0;
+    s.min = sorted[0];
+    s.p50 = percentile(sorted, n, 0.50);
+    s.p95 = percentile(sorted, n, 0.95);
+    s.max = sorted[n - 1];
+    free(sorted);
+    return s;
+}
+
+// runs whose modified z-score (distance from the median in MADs) is over
+// OUTLIER_Z; robust where mean/stddev get dragged along by the outliers
+static int count_outliers(const double *v, int n, double median) {
+    double *dev = malloc(n * sizeof(double));
+    if (!dev) return 0;
+    for (int i = 0; i < n; i++) dev[i] = fabs(v[i] - median);
+    qsort(dev, n, sizeof(double), cmp_double);
+    double mad = percentile(dev, n, 0.5);
+    free(dev);
+    if (mad == 0) return 0;
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        if (0.6745 * fabs(v[i] - median) / mad > OUTLIER_Z) count++;
+    }
+    return count;
+}
+
+static double tv_ms(struct timeval tv) {
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static void print_cmd(FILE *f, char **argv) {
+    for (int i = 0; argv[i]; i++) fprintf(f, i ? " %s" : "%s", argv[i]);
+}
+
+// one run, timed or not; returns its status, -1 if it couldn't start
+static int run_once(struct target *t, const struct bench_opts *o, int timed) {
+    double wall;
+    struct rusage ru;
+    if (o->prepare) {
+        int st = exec_run_timed(o->prepare, 1, &wall, &ru);
+        if (st != 0) {
+            fprintf(stderr, "bench: prepare command failed with status %d\n", st);
+            return st < 0 ? 1 : st;
+        }
+    }
+    int st = exec_run_timed(t->argv, o->quiet, &wall, &ru);
+    if (st < 0) {
+        fprintf(stderr, "bench: %s: could not start\n", t->argv[0]);
+        return 127;
+    }
+    if (timed) {
+        t->wall[t->runs] = wall;
+        t->user[t->runs] = tv_ms(ru.ru_utime);
+        t->sys[t->runs] = tv_ms(ru.ru_stime);
+        t->runs++;
+    }
+    return st;
+}
+
+// warmup and timed runs of one command; 0, or the status that stopped it
+static int measure(struct target *t, const struct bench_opts *o) {
+    for (int i = 0; i < o->warmup + o->runs; i++) {
+        int timed = i >= o->warmup;
+        int st = run_once(t, o, timed);
+        // ctrl-c / ctrl-z on a run (or at the shell between runs) stops the bench
+        if (st == 128 + SIGINT || st == 128 + SIGTSTP || eval_interrupted()) {
+            return st ? st : 128 + SIGINT;
+        }
+        if (st != 0 && !o->ignore_failure) {
+            fprintf(stderr, "bench: ");
+            print_cmd(stderr, t->argv);
+            fprintf(stderr, ": exited with status %d (use -i to ignore)\n", st);
+            return st;
+        }
+    }
+    // with -i every run can fail before it is timed (prepare failed, or the
+    // command couldn't start): nothing to summarize
+    if (t->runs == 0) {
+        fprintf(stderr, "bench: ");
+        print_cmd(stderr, t->argv);
+        fprintf(stderr, ": no run completed\n");
+        return 1;
+    }
+    t->s_wall = summarize(t->wall, t->runs);
+    t->s_user = summarize(t->user, t->runs);
+    t->s_sys = summarize(t->sys, t->runs);
+    t->outliers = count_outliers(t->wall, t->runs, t->s_wall.p50);
+    return 0;
+}
+
+static void print_row(const char *name, const struct stats *s) {
+    printf("  %-5s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+           name, s->mean, s->stddev, s->min, s->p50, s->p95, s->max);
+}
+
+static void report(const struct target *t, const struct bench_opts *o) {
+    printf("bench: ");
+    print_cmd(stdout, t->argv);
+    printf("  (%d runs, %d warmup)\n", t->runs, o->warmup);
+    printf("  %-5s %10s %10s %10s %10s %10s %10s\n", "ms", "mean", "stddev", "min", "p50", "p95", "max");
+    print_row("wall", &t->s_wall);
+    print_row("user", &t->s_user);
+    print_row("sys", &t->s_sys);
+    if (t->outliers > 0) {
+        printf("  %d of %d runs are outliers (modified z-score > %.1f), results may be noisy\n",
+               t->outliers, t->runs, OUTLIER_Z);
+    }
+}
+
+// "a ran 1.52 ± 0.04 times faster than b", uncertainty from both stddevs
+static void compare(const struct target *a, const struct target *b) {
+    const struct target *fast = a->s_wall.mean <= b->s_wall.mean ? a : b;
+    const struct target *slow = fast == a ? b : a;
+    if (fast->s_wall.mean <= 0) return;
+    double ratio = slow->s_wall.mean / fast->s_wall.mean;
+    double err = ratio * sqrt(pow(slow->s_wall.stddev / slow->s_wall.mean, 2) +
+                              pow(fast->s_wall.stddev / fast->s_wall.mean, 2));
+    printf("summary: ");
+    print_cmd(stdout, fast->argv);
+    printf("\n  ran %.2f ± %.2f times faster than ", ratio, err);
+    print_cmd(stdout, slow->argv);
+    putchar('\n');
+}
+
+// a field of CSV, quoted since commands may contain commas
+static void csv_cmd(FILE *f, char **argv) {
+    fputc('"', f);
+    for (int i = 0; argv[i]; i++) {
+        if (i) fputc(' ', f);
+        for (const char *c = argv[i]; *c; c++) {
+            if (*c == '"') fputc('"', f);
+            fputc(*c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static int export_csv(const char *path, struct target *t, int n) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "command,runs,outliers");
+    const char *names[] = { "wall", "user", "sys" };
+    for (int k = 0; k < 3; k++) {
+        fprintf(f, ",%s_mean_ms,%s_stddev_ms,%s_min_ms,%s_p50_ms,%s_p95_ms,%s_max_ms",
+                names[k], names[k], names[k], names[k], names[k], names[k]);
+    }
+    fputc('\n', f);
+    for (int i = 0; i < n; i++) {
+        csv_cmd(f, t[i].argv);
+        fprintf(f, ",%d,%d", t[i].runs, t[i].outliers);
+        const struct stats *s[] = { &t[i].s_wall, &t[i].s_user, &t[i].s_sys };
+        for (int k = 0; k < 3; k++) {
+            fprintf(f, ",%.6f,%.6f,%.6f,%.6f,%.6f,%.6f",
+                    s[k]->mean, s[k]->stddev, s[k]->min, s[k]->p50, s[k]->p95, s[k]->max);
+        }
+        fputc('\n', f);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static void json_string(FILE *f, char **argv) {
+    fputc('"', f);
+    for (int i = 0; argv[i]; i++) {
+        if (i) fputc(' ', f);
+        for (const unsigned char *c = (const unsigned char *)argv[i]; *c; c++) {
+            if (*c == '"' || *c == '\\') {
+                fprintf(f, "\\%c", *c);
+            } else if (*c < 0x20) {
+                fprintf(f, "\\u%04x", *c);
+            } else {
+                fputc(*c, f);
+            }
+        }
+    }
+    fputc('"', f);
+}
+
+static void json_stats(FILE *f, const char *name, const struct stats *s, const double *runs, int n) {
+    fprintf(f, "      \"%s\": {\"mean\": %.6f, \"stddev\": %.6f, \"min\": %.6f, "
+               "\"p50\": %.6f, \"p95\": %.6f, \"max\": %.6f, \"runs\": [",
+            name, s->mean, s->stddev, s->min, s->p50, s->p95, s->max);
+    for (int i = 0; i < n; i++) fprintf(f, i ? ", %.6f" : "%.6f", runs[i]);
+    fprintf(f, "]}");
+}
+
+static int export_json(const char *path, struct target *t, int n, const struct bench_opts *o) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "{\n  \"unit\": \"ms\",\n  \"warmup\": %d,\n  \"results\": [\n", o->warmup);
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "    {\n      \"command\": ");
+        json_string(f, t[i].argv);
+        fprintf(f, ",\n      \"outliers\": %d,\n", t[i].outliers);
+        json_stats(f, "wall", &t[i].s_wall, t[i].wall, t[i].runs);
+        fprintf(f, ",\n");
+        json_stats(f, "user", &t[i].s_user, t[i].user, t[i].runs);
+        fprintf(f, ",\n");
+        json_stats(f, "sys", &t[i].s_sys, t[i].sys, t[i].runs);
+        fprintf(f, "\n    }%s\n", i + 1 < n ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static int usage(void) {
+    fprintf(stderr, "bench: usage: bench [-n runs] [-w warmup] [-i] [--show-output] "
+                    "[--prepare cmd... --] [--csv file] [--json file] cmd... [--vs cmd...]\n");
+    return 2;
+}
+
+// positive integer option value
+static int count_arg(const char *s, int min, int *out) {
+    char *end;
+    long v = s ? strtol(s, &end, 10) : -1;
+    if (!s || *end != '\0' || v < min || v > 1000000) return 0;
+    *out = (int)v;
+    return 1;
+}
+
+static int bench(char **argv) {
+    struct bench_opts o = { 10, 0, 0, 1, NULL, NULL, NULL };
+    int i = 1;
+    for (; argv[i] && argv[i][0] == '-'; i++) {
+        char *a = argv[i];
+        if (strcmp(a, "-n") == 0) {
+            if (!count_arg(argv[++i], 1, &o.runs)) return usage();
+        } else if (strcmp(a, "-w") == 0) {
+            if (!count_arg(argv[++i], 0, &o.warmup)) return usage();
+        } else if (strcmp(a, "-i") == 0) {
+            o.ignore_failure = 1;
+        } else if (strcmp(a, "--show-output") == 0) {
+            o.quiet = 0;
+        } else if (strcmp(a, "--csv") == 0 || strcmp(a, "--json") == 0) {
+            if (!argv[i + 1]) return usage();
+            if (a[2] == 'c') {
+                o.csv = argv[++i];
+            } else {
+                o.json = argv[++i];
+            }
+        } else if (strcmp(a, "--prepare") == 0) {
+            // no quoting in the shell, so the prepare command runs up to "--"
+            o.prepare = &argv[i + 1];
+            while (argv[i + 1] && strcmp(argv[i + 1], "--") != 0) i++;
+            if (!argv[i + 1] || o.prepare == &argv[i + 1]) return usage();
+            argv[++i] = NULL;
+        } else {
+            return usage();
+        }
+    }
+    if (!argv[i]) return usage();
+
+    // cmd... [--vs cmd...]
+    struct target t[2];
+    memset(t, 0, sizeof(t));
+    int n = 1;
+    t[0].argv = &argv[i];
+    for (; argv[i]; i++) {
+        if (strcmp(argv[i], "--vs") == 0) {
+            argv[i] = NULL;
+            if (!argv[i + 1] || t[0].argv[0] == NULL) return usage();
+            t[1].argv = &argv[i + 1];
+            n = 2;
+            break;
+        }
+    }
+
+    int status = 0;
+    for (int k = 0; k < n && status == 0; k++) {
+        t[k].wall = calloc(o.runs, sizeof(double));
+        t[k].user = calloc(o.runs, sizeof(double));
+        t[k].sys = calloc(o.runs, sizeof(double));
+        if (!t[k].wall || !t[k].user || !t[k].sys) {
+            status = 1;
+            break;
+        }
+        status = measure(&t[k], &o);
+        if (status == 0) report(&t[k], &o);
+    }
+    if (status == 0 && n == 2) compare(&t[0], &t[1]);
+    if (status == 0 && o.csv && export_csv(o.csv, t, n) < 0) status = 1;
+    if (status == 0 && o.json && export_json(o.json, t, n, &o) < 0) status = 1;
+
+    for (int k = 0; k < n; k++) {
+        free(t[k].wall);
+        free(t[k].user);
+        free(t[k].sys);
+    }
+    return status;
+}
+
+int builtin_bench(char **argv) {
+    // the "--" / "--vs" separators get cut to NULL, so work on a copy of the
+    // pointer array and leave the command's own argv intact for free_command()
+    int argc = 0;
+    while (argv[argc]) argc++;
+    char **args = malloc((argc + 1) * sizeof(char *));
+    if (!args) return 1;
+    memcpy(args, argv, (argc + 1) * sizeof(char *));
+    int status = bench(args);
+    free(args);
+    return status;
+}
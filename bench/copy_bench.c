@@ -0,0 +1,177 @@
+// data movement: the cat/tee/cp builtins vs the coreutils programs
+// usage: copy_bench [megabytes] [dir]
+// every case starts its stages the way a pipeline does (exec_child), once
+// with the builtin name and once with the program's path, and drains pipes
+// into /dev/null with splice() so the reader side costs both the same
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "exec.h"
+
+#define ROUNDS 3
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// where name lives in PATH, so exec_child runs the program and not the builtin
+static char *program(const char *name) {
+    static char found[3][512];
+    static int next = 0;
+    const char *path = getenv("PATH");
+    char *dirs = strdup(path ? path : "/usr/bin:/bin");
+    char *save = NULL;
+    for (char *d = strtok_r(dirs, ":", &save); d; d = strtok_r(NULL, ":", &save)) {
+        char *buf = found[next % 3];
+        snprintf(buf, sizeof(found[0]), "%s/%s", d, name);
+        if (access(buf, X_OK) == 0) {
+            free(dirs);
+            next++;
+            return buf;
+        }
+    }
+    free(dirs);
+    fprintf(stderr, "%s: not in PATH\n", name);
+    exit(1);
+}
+
+static pid_t stage(char **argv, int in, int out) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) exec_child(argv, NULL, NULL, 0, 0, 0, in, out, -1, -1);
+    return pid;
+}
+
+static void drain(int fd) {
+    int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    while (splice(fd, NULL, null, NULL, 1 << 20, SPLICE_F_MOVE) > 0) continue;
+    close(null);
+}
+
+static void reap(pid_t pid) {
+    int st;
+    waitpid(pid, &st, 0);
+    if (!WIFEXITED(st) || WEXITSTATUS(st) != 0) fprintf(stderr, "stage %d failed\n", (int)pid);
+}
+
+// cat big | (reader)
+static double cat_to_pipe(const char *cat, const char *big) {
+    char *argv[] = { (char *)cat, (char *)big, NULL };
+    int p[2];
+    pipe2(p, O_CLOEXEC);
+    double t0 = now_s();
+    pid_t pid = stage(argv, -1, p[1]);
+    close(p[1]);
+    drain(p[0]);
+    close(p[0]);
+    reap(pid);
+    return now_s() - t0;
+}
+
+// cat big > out
+static double cat_to_file(const char *cat, const char *big, const char *out) {
+    char *argv[] = { (char *)cat, (char *)big, NULL };
+    int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    double t0 = now_s();
+    pid_t pid = stage(argv, -1, fd);
+    close(fd);
+    reap(pid);
+    return now_s() - t0;
+}
+
+// cat big | tee out | (reader), only tee changes
+static double tee_pipe(const char *tee, const char *big, const char *out) {
+    char *feed[] = { "cat", (char *)big, NULL };
+    char *argv[] = { (char *)tee, (char *)out, NULL };
+    int a[2], b[2];
+    pipe2(a, O_CLOEXEC);
+    pipe2(b, O_CLOEXEC);
+    double t0 = now_s();
+    pid_t p1 = stage(feed, -1, a[1]);
+    pid_t p2 = stage(argv, a[0], b[1]);
+    close(a[0]);
+    close(a[1]);
+    close(b[1]);
+    drain(b[0]);
+    close(b[0]);
+    reap(p1);
+    reap(p2);
+    return now_s() - t0;
+}
+
+// cp big out
+static double cp_file(const char *cp, const char *big, const char *out) {
+    char *argv[] = { (char *)cp, (char *)big, (char *)out, NULL };
+    unlink(out);
+    double t0 = now_s();
+    reap(stage(argv, -1, -1));
+    return now_s() - t0;
+}
+
+static void report(const char *what, double mb, double ours, double theirs) {
+    double gb = mb / 1024;
+    printf("%-22s builtin %6.2f GB/s   coreutils %6.2f GB/s   x%.2f\n",
+           what, gb / ours, gb / theirs, theirs / ours);
+}
+
+int main(int argc, char **argv) {
+    int mb = argc > 1 ? atoi(argv[1]) : 512;
+    const char *dir = argc > 2 ? argv[2] : "/tmp";
+    char big[512], out[512];
+    snprintf(big, sizeof(big), "%s/yash_copy_bench_%d", dir, mb);
+    snprintf(out, sizeof(out), "%s/yash_copy_bench_out", dir);
+
+    struct stat st;
+    if (stat(big, &st) != 0 || st.st_size != (off_t)mb << 20) {
+        printf("creating %d MB in %s ...\n", mb, big);
+        int fd = open(big, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        char *chunk = malloc(1 << 20);
+        if (fd < 0 || !chunk) {
+            perror(big);
+            return 1;
+        }
+        for (int i = 0; i < 1 << 20; i++) chunk[i] = (char)(i * 131 + 7);
+        for (int i = 0; i < mb; i++) {
+            if (write(fd, chunk, 1 << 20) != 1 << 20) {
+                perror(big);
+                return 1;
+            }
+        }
+        free(chunk);
+        close(fd);
+    }
+    cat_to_pipe("cat", big); // warm the page cache
+
+    char *cat = program("cat"), *tee = program("tee"), *cp = program("cp");
+    double best[4][2];
+    for (int c = 0; c < 4; c++) best[c][0] = best[c][1] = 1e9;
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int real = 0; real < 2; real++) {
+            double t;
+            t = cat_to_pipe(real ? cat : "cat", big);
+            if (t < best[0][real]) best[0][real] = t;
+            t = cat_to_file(real ? cat : "cat", big, out);
+            if (t < best[1][real]) best[1][real] = t;
+            t = tee_pipe(real ? tee : "tee", big, out);
+            if (t < best[2][real]) best[2][real] = t;
+            t = cp_file(real ? cp : "cp", big, out);
+            if (t < best[3][real]) best[3][real] = t;
+        }
+    }
+    unlink(out);
+
+    printf("%d MB, best of %d\n", mb, ROUNDS);
+    report("cat file | pipe", mb, best[0][0], best[0][1]);
+    report("cat file > file", mb, best[1][0], best[1][1]);
+    report("pipe | tee file | pipe", mb, best[2][0], best[2][1]);
+    report("cp file file", mb, best[3][0], best[3][1]);
+    return 0;
+}
@@ -0,0 +1,106 @@
+// pathname expansion speed: the shell's pathexp vs glob(3)
+// usage: glob_bench [files] [dir]
+// fills dir (default: a fresh directory under /tmp) with files and expands a
+// few patterns over it, once cold per pattern and once as one command line
+// sharing the directory listing cache
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glob.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pathexp.h"
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static const char *patterns[] = { "*.log", "file_01*", "*[0-4].txt" };
+#define NPAT (int)(sizeof(patterns) / sizeof(patterns[0]))
+#define ROUNDS 5
+
+static void free_words(char **v, int n) {
+    for (int i = 0; i < n; i++) free(v[i]);
+    free(v);
+}
+
+int main(int argc, char **argv) {
+    int files = argc > 1 ? atoi(argv[1]) : 100000;
+    char dir[256];
+    if (argc > 2) {
+        snprintf(dir, sizeof(dir), "%s", argv[2]);
+    } else {
+        snprintf(dir, sizeof(dir), "/tmp/yash_glob_bench_%d", files);
+    }
+
+    char probe[512];
+    snprintf(probe, sizeof(probe), "%s/file_%06d.%s", dir, files - 1, (files - 1) % 2 ? "txt" : "log");
+    if (access(probe, F_OK) != 0) {
+        printf("creating %d files in %s ...\n", files, dir);
+        mkdir(dir, 0755);
+        for (int i = 0; i < files; i++) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/file_%06d.%s", dir, i, i % 2 ? "txt" : "log");
+            int fd = open(path, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                perror(path);
+                return 1;
+            }
+            close(fd);
+        }
+    }
+    if (chdir(dir) < 0) {
+        perror(dir);
+        return 1;
+    }
+
+    double glob_ms = 0, cold_ms = 0, shared_ms = 0;
+    size_t glob_matches = 0, ours_matches = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        // glob(3), one full scan per pattern
+        double t0 = now_ms();
+        for (int p = 0; p < NPAT; p++) {
+            glob_t g;
+            if (glob(patterns[p], 0, NULL, &g) == 0) glob_matches += g.gl_pathc;
+            globfree(&g);
+        }
+        glob_ms += now_ms() - t0;
+
+        // pathexp with the cache dropped between patterns
+        t0 = now_ms();
+        for (int p = 0; p < NPAT; p++) {
+            char **v = NULL;
+            int n = 0;
+            if (pathexp_expand(patterns[p], &v, &n) > 0) ours_matches += n;
+            free_words(v, n);
+            pathexp_cache_clear();
+        }
+        cold_ms += now_ms() - t0;
+
+        // pathexp as one command line ("cmd *.log file_01* *[0-4].txt")
+        t0 = now_ms();
+        for (int p = 0; p < NPAT; p++) {
+            char **v = NULL;
+            int n = 0;
+            pathexp_expand(patterns[p], &v, &n);
+            free_words(v, n);
+        }
+        pathexp_cache_clear();
+        shared_ms += now_ms() - t0;
+    }
+
+    if (glob_matches != ours_matches) {
+        fprintf(stderr, "match counts differ: glob %zu, pathexp %zu\n", glob_matches, ours_matches);
+        return 1;
+    }
+    printf("%d files, %d patterns, %zu matches per round, mean of %d rounds\n", files, NPAT, glob_matches / ROUNDS, ROUNDS);
+    printf("  glob(3)                 %8.2f ms\n", glob_ms / ROUNDS);
+    printf("  pathexp, cold per word  %8.2f ms  (%.2fx)\n", cold_ms / ROUNDS, glob_ms / cold_ms);
+    printf("  pathexp, shared listing %8.2f ms  (%.2fx)\n", shared_ms / ROUNDS, glob_ms / shared_ms);
+    return 0;
+}
@@ -0,0 +1,132 @@
+// pipeline placement: a memory-bound producer/consumer pair through a pipe,
+// unpinned, on the pair "set -o pin=on" picks, and on the farthest pair
+// usage: pin_bench [megabytes per run]
+// the producer streams a buffer bigger than the caches into the pipe and the
+// consumer sums everything it reads, so every byte goes producer -> kernel ->
+// consumer, and how close the two CPUs are decides how far it travels
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "topo.h"
+
+#define ROUNDS 3
+#define CHUNK (256 * 1024)
+#define SOURCE (64 << 20)   // producer's buffer, walked round and round
+#define PIPE_SIZE (1 << 20)
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pin(int cpu) {
+    if (cpu < 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+static void producer(int out, long long total) {
+    char *src = malloc(SOURCE);
+    if (!src) _exit(1);
+    for (int i = 0; i < SOURCE; i++) src[i] = (char)(i * 131 + 7);
+    for (long long sent = 0; sent < total;) {
+        ssize_t w = write(out, src + sent % SOURCE, CHUNK);
+        if (w <= 0) _exit(1);
+        sent += w;
+    }
+    _exit(0);
+}
+
+static void consumer(int in) {
+    char *buf = malloc(CHUNK);
+    unsigned long sum = 0;
+    ssize_t n;
+    if (!buf) _exit(1);
+    while ((n = read(in, buf, CHUNK)) > 0) {
+        for (ssize_t i = 0; i < n; i += 64) sum += (unsigned char)buf[i];
+    }
+    _exit(sum == 1); // keeps the loop from being optimized away
+}
+
+// one run with the stages on a and b (-1 = wherever the scheduler likes), GB/s
+static double run(int a, int b, int mb) {
+    long long total = (long long)mb << 20;
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) return 0;
+    fcntl(p[1], F_SETPIPE_SZ, PIPE_SIZE);
+    double t0 = now_s();
+    pid_t left = fork();
+    if (left == 0) {
+        pin(a);
+        close(p[0]);
+        producer(p[1], total);
+    }
+    pid_t right = fork();
+    if (right == 0) {
+        pin(b);
+        close(p[1]);
+        consumer(p[0]);
+    }
+    close(p[0]);
+    close(p[1]);
+    waitpid(left, NULL, 0);
+    waitpid(right, NULL, 0);
+    return mb / 1024.0 / (now_s() - t0);
+}
+
+static double best(int a, int b, int mb) {
+    double top = 0;
+    for (int i = 0; i < ROUNDS; i++) {
+        double r = run(a, b, mb);
+        if (r > top) top = r;
+    }
+    return top;
+}
+
+int main(int argc, char **argv) {
+    int mb = argc > 1 ? atoi(argv[1]) : 4096;
+    static int cpus[CPU_SETSIZE];
+    int n = topo_cpus(cpus, CPU_SETSIZE);
+
+    printf("%d MB per run, best of %d, %d usable CPUs\n", mb, ROUNDS, n);
+    double free_run = best(-1, -1, mb);
+    printf("%-44s %6.2f GB/s\n", "unpinned", free_run);
+    if (n < 2) {
+        printf("placement needs at least 2 CPUs\n");
+        return 0;
+    }
+
+    int near[2], far[2] = { cpus[0], cpus[1] };
+    topo_set_mode(PIN_ON);
+    topo_place_pair(near);
+    topo_rel_t worst = topo_relation(far[0], far[1]);
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j < n; j++) {
+            topo_rel_t rel = topo_relation(cpus[i], cpus[j]);
+            if (rel > worst) {
+                worst = rel;
+                far[0] = cpus[i];
+                far[1] = cpus[j];
+            }
+        }
+    }
+
+    char label[128];
+    snprintf(label, sizeof(label), "pin=on: cpu %d -> %d (%s)", near[0], near[1],
+             topo_relation_name(topo_relation(near[0], near[1])));
+    double near_run = best(near[0], near[1], mb);
+    printf("%-44s %6.2f GB/s   x%.2f\n", label, near_run, near_run / free_run);
+    snprintf(label, sizeof(label), "farthest: cpu %d -> %d (%s)", far[0], far[1], topo_relation_name(worst));
+    double far_run = best(far[0], far[1], mb);
+    printf("%-44s %6.2f GB/s   x%.2f\n", label, far_run, far_run / free_run);
+    return 0;
+}
@@ -0,0 +1,89 @@
+// spawn latency with and without the launcher helper (zygote) as the shell grows
+// usage: spawn_bench [iterations]
+// for each resident size the shell touches that much memory, then times
+// fork+exec+wait of /bin/true both ways
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "exec.h"
+#include "zygote.h"
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// runs /bin/true n times and stores each spawn-to-reap time in out[]
+static int measure(int use_zygote, int n, double *out) {
+    char *argv[] = { "/bin/true", NULL };
+    for (int i = 0; i < n; i++) {
+        double t0 = now_us();
+        pid_t pid;
+        if (use_zygote) {
+            struct zygote_req req = { argv, NULL, NULL, 0, 0, 0, -1, -1, -1, -1, -1 };
+            pid = zygote_spawn(&req);
+        } else {
+            pid = fork();
+            if (pid == 0) exec_child(argv, NULL, NULL, 0, 0, 0, -1, -1, -1, -1);
+        }
+        if (pid < 0) {
+            perror("spawn");
+            return -1;
+        }
+        waitpid(pid, NULL, 0);
+        out[i] = now_us() - t0;
+    }
+    qsort(out, n, sizeof(double), cmp_double);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int iters = argc > 1 ? atoi(argv[1]) : 200;
+    if (iters < 1) iters = 1;
+
+    // start the helper while we are still tiny, like the shell does with -z
+    if (zygote_start() < 0) {
+        perror("zygote_start");
+        return 1;
+    }
+
+    static const size_t sizes_mb[] = { 10, 100, 250, 500, 1000 };
+    double *fork_t = malloc(sizeof(double) * iters);
+    double *zyg_t = malloc(sizeof(double) * iters);
+    char *ballast = NULL;
+    if (!fork_t || !zyg_t) return 1;
+
+    printf("%8s  %12s %12s  %12s %12s  %7s\n", "rss(MB)", "fork p50(us)", "fork p95", "zyg p50(us)", "zyg p95", "speedup");
+    for (size_t i = 0; i < sizeof(sizes_mb) / sizeof(sizes_mb[0]); i++) {
+        size_t bytes = sizes_mb[i] << 20;
+        free(ballast);
+        ballast = malloc(bytes);
+        if (!ballast) {
+            fprintf(stderr, "could not allocate %zu MB, stopping\n", sizes_mb[i]);
+            break;
+        }
+        memset(ballast, 1, bytes); // make it resident
+
+        if (measure(0, iters, fork_t) < 0 || measure(1, iters, zyg_t) < 0) return 1;
+        double fp50 = fork_t[iters / 2], fp95 = fork_t[iters * 95 / 100];
+        double zp50 = zyg_t[iters / 2], zp95 = zyg_t[iters * 95 / 100];
+        printf("%8zu  %12.1f %12.1f  %12.1f %12.1f  %6.2fx\n", sizes_mb[i], fp50, fp95, zp50, zp95, fp50 / zp50);
+        fflush(stdout);
+    }
+
+    free(ballast);
+    free(fork_t);
+    free(zyg_t);
+    zygote_stop();
+    return 0;
+}
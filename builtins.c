@@ -0,0 +1,212 @@
+#define _GNU_SOURCE
+#include "builtins.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+
+/* ---------- compiled-in builtins: perfect hash ---------- */
+
+// slot of a name from its first two chars, last char and length; with these
+// weights every builtin lands in its own slot (checked by the compiler, see below)
+#define BUILTIN_SLOTS 128
+#define SLOT(c0, c1, clast, len) (((c0) + 5 * (c1) + 2 * (clast) + (len)) & (BUILTIN_SLOTS - 1))
+
+static unsigned slot_of(const char *name, size_t len) {
+    unsigned char c0 = name[0], c1 = len > 1 ? name[1] : 0, clast = name[len - 1];
+    return SLOT(c0, c1, clast, len);
+}
+
+// adding a builtin: add a line with its chars spelled out; if two names share
+// a slot the build fails on the override-init error, then tweak SLOT's weights
+#pragma GCC diagnostic push
+#pragma GCC diagnostic error "-Woverride-init"
+static const struct builtin table[BUILTIN_SLOTS] = {
+    [SLOT('j', 'o', 's', 4)] = { "jobs", builtin_jobs, NULL },
+    [SLOT('f', 'g', 'g', 2)] = { "fg", builtin_fg, NULL },
+    [SLOT('b', 'g', 'g', 2)] = { "bg", builtin_bg, NULL },
+    [SLOT(':', 0, ':', 1)] = { ":", builtin_true, NULL, BUILTIN_PURE },
+    [SLOT('t', 'r', 'e', 4)] = { "true", builtin_true, NULL, BUILTIN_PURE },
+    [SLOT('f', 'a', 'e', 5)] = { "false", builtin_false, NULL, BUILTIN_PURE },
+    [SLOT('b', 'r', 'k', 5)] = { "break", builtin_break, NULL },
+    [SLOT('c', 'o', 'e', 8)] = { "continue", builtin_continue, NULL },
+    [SLOT('e', 'c', 'o', 4)] = { "echo", builtin_echo, NULL, BUILTIN_PURE },
+    [SLOT('e', 'x', 't', 6)] = { "export", builtin_export, NULL },
+    [SLOT('u', 'n', 't', 5)] = { "unset", builtin_unset, NULL },
+    [SLOT('w', 'a', 't', 4)] = { "wait", builtin_wait, NULL },
+    [SLOT('s', 'e', 't', 3)] = { "set", builtin_set, NULL },
+    [SLOT('e', 'n', 'e', 6)] = { "enable", builtin_enable, NULL },
+    [SLOT('b', 'e', 'h', 5)] = { "bench", builtin_bench, NULL },
+    [SLOT('k', 'i', 'l', 4)] = { "kill", builtin_kill, NULL },
+    [SLOT('p', 'w', 'd', 3)] = { "pwd", builtin_pwd, NULL, BUILTIN_PURE },
+    [SLOT('c', 'a', 't', 3)] = { "cat", builtin_cat, NULL, BUILTIN_NOEXEC },
+    [SLOT('t', 'e', 'e', 3)] = { "tee", builtin_tee, NULL, BUILTIN_NOEXEC },
+    [SLOT('c', 'p', 'p', 2)] = { "cp", builtin_cp, NULL, BUILTIN_NOEXEC },
+    [SLOT('c', 'a', 'e', 5)] = { "cache", builtin_cache, NULL },
+    [SLOT('c', 'o', 'c', 6)] = { "coproc", builtin_coproc, NULL },
+};
+#pragma GCC diagnostic pop
+
+/* ---------- loaded builtins ---------- */
+
+struct loaded {
+    struct builtin b;
+    void *handle;
+    char *path;
+    struct loaded *next;
+};
+
+static struct loaded *loaded = NULL;
+
+static struct loaded *find_loaded(const char *name) {
+    for (struct loaded *l = loaded; l; l = l->next) {
+        if (strcmp(l->b.name, name) == 0) return l;
+    }
+    return NULL;
+}
+
+const struct builtin *builtin_find(const char *name) {
+    if (loaded) {
+        struct loaded *l = find_loaded(name);
+        if (l) return &l->b;
+    }
+    size_t len = strlen(name);
+    if (len == 0) return NULL;
+    const struct builtin *b = &table[slot_of(name, len)];
+    if (b->name && strcmp(b->name, name) == 0) return b;
+    return NULL;
+}
+
+int builtin_forkable(const struct builtin *b) {
+    return b->ext || (b->flags & (BUILTIN_PURE | BUILTIN_NOEXEC));
+}
+
+int builtin_run(const struct builtin *b, char **argv) {
+    if (b->fn) return b->fn(argv);
+    int argc = 0;
+    while (argv[argc]) argc++;
+    int status = b->ext->run(argc, argv);
+    fflush(stdout);
+    fflush(stderr);
+    return status;
+}
+
+int builtin_load(const char *path, const char *name) {
+    if (find_loaded(name)) {
+        fprintf(stderr, "enable: %s: already loaded\n", name);
+        return -1;
+    }
+
+    // RTLD_LOCAL so two libraries can't clash; a path without a slash is
+    // searched the usual dlopen way (LD_LIBRARY_PATH, ...)
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        fprintf(stderr, "enable: %s\n", dlerror());
+        return -1;
+    }
+
+    char sym[256];
+    snprintf(sym, sizeof(sym), "yash_builtin_%s", name);
+    const struct yash_builtin *ext = dlsym(handle, sym);
+    if (!ext) {
+        fprintf(stderr, "enable: %s: no %s in %s\n", name, sym, path);
+        dlclose(handle);
+        return -1;
+    }
+    if (ext->abi != YASH_BUILTIN_ABI || !ext->run) {
+        fprintf(stderr, "enable: %s: built for builtin ABI %u, this shell has %d\n",
+                name, ext->abi, YASH_BUILTIN_ABI);
+        dlclose(handle);
+        return -1;
+    }
+    if (ext->load && ext->load() != 0) {
+        fprintf(stderr, "enable: %s: refused to load\n", name);
+        dlclose(handle);
+        return -1;
+    }
+
+    struct loaded *l = calloc(1, sizeof(*l));
+    char *path_copy = strdup(path);
+    char *name_copy = strdup(name);
+    if (!l || !path_copy || !name_copy) {
+        free(l);
+        free(path_copy);
+        free(name_copy);
+        if (ext->unload) ext->unload();
+        dlclose(handle);
+        return -1;
+    }
+    // registered under the name asked for, which is the one in the symbol
+    l->b.name = name_copy;
+    l->b.ext = ext;
+    l->handle = handle;
+    l->path = path_copy;
+    l->next = loaded;
+    loaded = l;
+    return 0;
+}
+
+int builtin_unload(const char *name) {
+    for (struct loaded **pp = &loaded; *pp; pp = &(*pp)->next) {
+        struct loaded *l = *pp;
+        if (strcmp(l->b.name, name) != 0) continue;
+        *pp = l->next;
+        if (l->b.ext->unload) l->b.ext->unload();
+        dlclose(l->handle); // dlopen refcounts, other builtins of the library stay mapped
+        free((char *)l->b.name);
+        free(l->path);
+        free(l);
+        return 0;
+    }
+    return -1;
+}
+
+static int cmp_name(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static void print_builtins(void) {
+    const char *names[BUILTIN_SLOTS];
+    int n = 0;
+    for (int i = 0; i < BUILTIN_SLOTS; i++) {
+        if (table[i].name) names[n++] = table[i].name;
+    }
+    qsort(names, n, sizeof(names[0]), cmp_name);
+    for (int i = 0; i < n; i++) {
+        // a loaded builtin of the same name hides the compiled-in one
+        printf("enable %s%s\n", names[i], find_loaded(names[i]) ? " (replaced)" : "");
+    }
+    for (struct loaded *l = loaded; l; l = l->next) {
+        printf("enable -f %s %s", l->path, l->b.name);
+        if (l->b.ext->usage) printf("    # %s", l->b.ext->usage);
+        putchar('\n');
+    }
+}
+
+int builtin_enable(char **argv) {
+    if (!argv[1]) {
+        print_builtins();
+        return 0;
+    }
+    int status = 0;
+    if (strcmp(argv[1], "-f") == 0) {
+        if (!argv[2] || !argv[3]) {
+            fprintf(stderr, "enable: usage: enable -f lib.so name...\n");
+            return 2;
+        }
+        for (int i = 3; argv[i]; i++) {
+            if (builtin_load(argv[2], argv[i]) < 0) status = 1;
+        }
+    } else if (strcmp(argv[1], "-d") == 0) {
+        for (int i = 2; argv[i]; i++) {
+            if (builtin_unload(argv[i]) < 0) {
+                fprintf(stderr, "enable: %s: not a loaded builtin\n", argv[i]);
+                status = 1;
+            }
+        }
+    } else {
+        fprintf(stderr, "enable: usage: enable [-f lib.so name...] [-d name...]\n");
+        return 2;
+    }
+    return status;
+}
@@ -0,0 +1,79 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "yash_builtin.h"
+
+typedef int (*builtin_fn)(char **argv);
+
+// one entry of the builtin registry: compiled in (fn) or loaded (ext)
+struct builtin {
+    const char *name;
+    builtin_fn fn;
+    const struct yash_builtin *ext;
+    int flags;
+};
+
+// the builtin only writes output and changes no shell state, so a $(...) made
+// of nothing else can run in the shell process instead of a forked subshell
+#define BUILTIN_PURE 1
+
+// the builtin runs where an external command would, in the job's own
+// process (forked, or from the launcher helper) instead of exec'ing a program,
+// so it gets job control and pipeline fds like one (exec_child)
+#define BUILTIN_NOEXEC 2
+
+// looks a command name up, loaded builtins first so they can replace a
+// compiled-in one; NULL if it isn't a builtin
+const struct builtin *builtin_find(const char *name);
+
+// 1 if it can run in a forked child the way a program would, so a pipeline
+// stage or a background job gets it instead of exec'ing a same-named program:
+// the BUILTIN_NOEXEC and BUILTIN_PURE ones, and every loaded one (they only
+// see their argv and fds); 0 for the ones that act on the shell's own state
+int builtin_forkable(const struct builtin *b);
+
+// runs it in the shell process with argv as given (redirections are the caller's)
+int builtin_run(const struct builtin *b, char **argv);
+
+// dlopen()s path and registers its yash_builtin_<name> descriptor
+// returns 0 on success, -1 with a message on stderr otherwise
+int builtin_load(const char *path, const char *name);
+
+// unregisters a loaded builtin, closing its library when it was the last one
+// returns 0 on success, -1 if name wasn't loaded
+int builtin_unload(const char *name);
+
+// enable [-f lib.so name...] [-d name...], no args lists every builtin
+int builtin_enable(char **argv);
+
+// the compiled-in builtins (eval.c)
+int builtin_jobs(char **argv);
+int builtin_fg(char **argv);
+int builtin_bg(char **argv);
+int builtin_true(char **argv);
+int builtin_false(char **argv);
+int builtin_break(char **argv);
+int builtin_continue(char **argv);
+int builtin_echo(char **argv);
+int builtin_export(char **argv);
+int builtin_unset(char **argv);
+int builtin_wait(char **argv);
+int builtin_set(char **argv);
+int builtin_kill(char **argv);
+int builtin_pwd(char **argv);
+
+// bench.c
+int builtin_bench(char **argv);
+
+// copy.c
+int builtin_cat(char **argv);
+int builtin_tee(char **argv);
+int builtin_cp(char **argv);
+
+// cache.c
+int builtin_cache(char **argv);
+
+// coproc.c
+int builtin_coproc(char **argv);
+
+#endif /* BUILTINS_H */
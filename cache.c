@@ -0,0 +1,449 @@
+#define _GNU_SOURCE
+#include "cache.h"
+#include "builtins.h"
+#include "exec.h"
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define ENTRY_MAGIC "yashc001"
+#define MAX_KEY_ENV 16
+#define READ_CHUNK (64 * 1024)
+#define STALE_TMP 3600  // seconds before a leftover .tmp (a shell that died mid-run) goes
+
+// an entry file: this header, the key it was stored under, stdout, stderr
+struct entry_header {
+    char magic[8];
+    int64_t created;    // wall clock seconds, for the ttl
+    int32_t status;
+    uint32_t key_len;
+    uint64_t out_len;
+    uint64_t err_len;
+};
+
+// growable byte buffer: the key text, and stderr while a miss runs
+struct buf {
+    char *data;
+    size_t len, cap;
+    int failed;
+};
+
+static long max_size = CACHE_DEFAULT_MAX;
+
+// always part of the key: a different PATH or locale may mean different output
+static const char *const base_env[] = { "PATH", "LANG", "LC_ALL" };
+
+void cache_set_max_size(long bytes) {
+    max_size = bytes;
+}
+
+long cache_get_max_size(void) {
+    return max_size;
+}
+
+static void buf_add(struct buf *b, const void *data, size_t len) {
+    if (b->failed) return;
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap < b->len + len) cap *= 2;
+        char *grown = realloc(b->data, cap);
+        if (!grown) {
+            b->failed = 1;
+            return;
+        }
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+// one NUL-terminated field, so "a b" and "ab" never give the same key
+static void key_field(struct buf *k, const char *s) {
+    buf_add(k, s, strlen(s) + 1);
+}
+
+static uint64_t fnv1a(const char *s, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void key_env(struct buf *k, const char *name) {
+    const char *v = vars_get(name);
+    char field[4096];
+    // unset and empty are different keys
+    snprintf(field, sizeof(field), v ? "env %s=%s" : "env %s", name, v);
+    key_field(k, field);
+}
+
+// a key file counts by which file it is and when it last changed, so an
+// edit (or a file replaced by rename) starts a new entry
+static void key_file(struct buf *k, const char *path) {
+    struct stat st;
+    char field[4096 + 128];
+    if (stat(path, &st) < 0) {
+        snprintf(field, sizeof(field), "file %s missing", path);
+    } else {
+        snprintf(field, sizeof(field), "file %s %lu %lu %lld %lld.%09ld", path, (unsigned long)st.st_dev,
+                 (unsigned long)st.st_ino, (long long)st.st_size, (long long)st.st_mtim.tv_sec,
+                 st.st_mtim.tv_nsec);
+    }
+    key_field(k, field);
+}
+
+/* ---------- the store ---------- */
+
+// mkdir -p of the cache directory; 0 on success
+static int store_dir(char *out, size_t size) {
+    const char *xdg = vars_get("XDG_CACHE_HOME");
+    const char *home = vars_get("HOME");
+    if (xdg && *xdg) {
+        snprintf(out, size, "%s/yash", xdg);
+    } else if (home && *home) {
+        snprintf(out, size, "%s/.cache/yash", home);
+    } else {
+        return -1;
+    }
+    for (char *p = out + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        int rc = mkdir(out, 0700);
+        *p = '/';
+        if (rc < 0 && errno != EEXIST) return -1;
+    }
+    return mkdir(out, 0700) < 0 && errno != EEXIST ? -1 : 0;
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, data, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += w;
+        len -= w;
+    }
+    return 0;
+}
+
+// len bytes of in from off to out; sendfile() where out takes it, read/write
+// for the rest (some ttys)
+static int send_range(int in, off_t off, uint64_t len, int out) {
+    while (len > 0) {
+        ssize_t n = sendfile(out, in, &off, len > (1 << 30) ? (1 << 30) : len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len -= n;
+    }
+    char buf[READ_CHUNK];
+    while (len > 0) {
+        ssize_t n = pread(in, buf, len > sizeof(buf) ? sizeof(buf) : len, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || write_all(out, buf, n) < 0) return -1;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// replays the entry at path if it was stored under key and is younger than
+// ttl (0 = no limit); returns its exit status, -1 on a miss
+static int replay(const char *path, const struct buf *key, long ttl) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct entry_header h;
+    struct stat st;
+    char *stored = malloc(key->len);
+    int ok = stored && pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) && fstat(fd, &st) == 0 &&
+             memcmp(h.magic, ENTRY_MAGIC, 8) == 0 && h.key_len == key->len &&
+             (uint64_t)st.st_size == sizeof(h) + h.key_len + h.out_len + h.err_len &&
+             pread(fd, stored, key->len, sizeof(h)) == (ssize_t)key->len &&
+             memcmp(stored, key->data, key->len) == 0; // a hash collision is a miss
+    free(stored);
+    if (!ok || (ttl > 0 && time(NULL) - h.created >= ttl)) {
+        close(fd);
+        return -1;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    off_t off = sizeof(h) + h.key_len;
+    if (send_range(fd, off, h.out_len, STDOUT_FILENO) < 0 ||
+        send_range(fd, off + h.out_len, h.err_len, STDERR_FILENO) < 0) {
+        // the entry came up short or the output refused it: not a hit, and
+        // not an entry to try again
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    futimens(fd, NULL); // the mtime is what eviction goes by
+    close(fd);
+    return h.status;
+}
+
+struct victim {
+    char name[32];
+    off_t size;
+    struct timespec used;
+};
+
+static int by_age(const void *a, const void *b) {
+    const struct timespec *x = &((const struct victim *)a)->used, *y = &((const struct victim *)b)->used;
+    if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+// drops least recently used entries until the store fits in max_size
+static void evict(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct victim *v = NULL;
+    int n = 0, cap = 0;
+    off_t total = 0;
+    time_t now = time(NULL);
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        size_t len = strlen(e->d_name);
+        struct stat st;
+        if (e->d_name[0] == '.' || len >= sizeof(v->name)) continue;
+        if (fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0 || !S_ISREG(st.st_mode)) continue;
+        if (len > 4 && strcmp(e->d_name + len - 4, ".tmp") == 0) {
+            if (now - st.st_mtime > STALE_TMP) unlinkat(dirfd(d), e->d_name, 0);
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            struct victim *grown = realloc(v, cap * sizeof(*v));
+            if (!grown) break;
+            v = grown;
+        }
+        strcpy(v[n].name, e->d_name);
+        v[n].size = st.st_size;
+        v[n].used = st.st_mtim;
+        total += st.st_size;
+        n++;
+    }
+    if (total > max_size) {
+        qsort(v, n, sizeof(*v), by_age);
+        for (int i = 0; i < n && total > max_size; i++) {
+            if (unlinkat(dirfd(d), v[i].name, 0) == 0) total -= v[i].size;
+        }
+    }
+    free(v);
+    closedir(d);
+}
+
+/* ---------- running on a miss ---------- */
+
+// copies what one of the command's pipes has to our own fd and, unless
+// store is -1, into the entry (mem: kept in memory instead); a failed store
+// write sets *failed, the command's output still gets through
+// returns 0 at EOF (or EAGAIN), 1 if there may be more
+static int pump(int from, int to, int store, struct buf *mem, off_t *stored, int *failed) {
+    char chunk[READ_CHUNK];
+    ssize_t n = read(from, chunk, sizeof(chunk));
+    if (n < 0) return errno == EINTR;
+    if (n == 0) return 0;
+    write_all(to, chunk, n); // a closed reader of ours shouldn't spoil the entry
+    if (store < 0) return 1;
+    if (mem) {
+        buf_add(mem, chunk, n);
+        if (mem->failed) *failed = 1;
+    } else if (write_all(store, chunk, n) < 0) {
+        *failed = 1;
+    }
+    *stored += n;
+    return 1;
+}
+
+// runs argv with its stdout and stderr on pipes, passing both through to
+// ours and into the entry open on store (-1 = just run it); stderr is kept
+// in memory and goes after stdout at the end
+// returns the exit status, with *complete set when the output is all there
+static int run_and_capture(char **argv, int store, struct entry_header *h, int *complete) {
+    int out[2], err[2];
+    *complete = 0;
+    if (pipe2(out, O_CLOEXEC) < 0) return 1;
+    if (pipe2(err, O_CLOEXEC) < 0) {
+        close(out[0]);
+        close(out[1]);
+        return 1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = exec_start_foreground(argv, NULL, 0, out[1], err[1]);
+    close(out[1]);
+    close(err[1]);
+    if (pid < 0) {
+        close(out[0]);
+        close(err[0]);
+        fprintf(stderr, "cache: %s: could not start\n", argv[0]);
+        return 127;
+    }
+
+    // the pidfd ends the copy when cmd exits even if something it put in the
+    // background still holds the pipes open
+    int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    struct buf errs = {0};
+    off_t out_len = 0, err_len = 0, total = sizeof(*h) + h->key_len;
+    struct pollfd p[3] = { { out[0], POLLIN, 0 }, { err[0], POLLIN, 0 }, { pidfd, POLLIN, 0 } };
+    int stopped = 0, exited = 0, failed = 0;
+    while ((p[0].fd >= 0 || p[1].fd >= 0) && !stopped) {
+        int n = poll(p, 3, exited ? 0 : 100);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        if (n == 0) {
+            if (exited) break; // gone, and nothing left to read right now
+            // ctrl-z stops cmd but not us; the wait below ends it
+            siginfo_t si = {0};
+            stopped = waitid(P_PID, pid, &si, WSTOPPED | WNOHANG | WNOWAIT) == 0 && si.si_pid == pid;
+            continue;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (p[i].fd < 0 || !p[i].revents) continue;
+            int rc = pump(p[i].fd, i ? STDERR_FILENO : STDOUT_FILENO, failed ? -1 : store,
+                          i ? &errs : NULL, i ? &err_len : &out_len, &failed);
+            if (rc == 0) {
+                close(p[i].fd);
+                p[i].fd = -1;
+            }
+        }
+        if (p[2].fd >= 0 && p[2].revents) {
+            exited = 1;
+            close(p[2].fd); // stays readable, polling it again would spin
+            p[2].fd = -1;
+        }
+        if (total + out_len + err_len > max_size) failed = 1; // would only evict itself
+    }
+    if (p[0].fd >= 0 || p[1].fd >= 0 || stopped) failed = 1; // not all of the output
+    for (int i = 0; i < 3; i++) {
+        if (p[i].fd >= 0) close(p[i].fd);
+    }
+
+    int status = exec_wait_foreground(pid, NULL);
+    // killed, ctrl-c'd or stopped runs aren't what the command prints, and
+    // 126/127 means it never ran
+    if (status >= 0 && status < 126 && !failed && store >= 0 &&
+        write_all(store, errs.data, errs.len) == 0) {
+        h->status = status;
+        h->out_len = out_len;
+        h->err_len = err_len;
+        *complete = pwrite(store, h, sizeof(*h), 0) == (ssize_t)sizeof(*h);
+    }
+    free(errs.data);
+    return status < 0 ? 1 : status;
+}
+
+/* ---------- the builtin ---------- */
+
+static int usage(void) {
+    fprintf(stderr, "cache: usage: cache [-t ttl] [-e NAME]... [--key-files file... --] cmd...\n");
+    return 2;
+}
+
+// seconds, or a number with s/m/h/d after it
+static int ttl_arg(const char *s, long *out) {
+    char *end;
+    long v = s ? strtol(s, &end, 10) : -1;
+    if (!s || end == s || v < 0) return 0;
+    const char *units = "smhd";
+    static const long seconds[] = { 1, 60, 3600, 86400 };
+    if (*end == '\0') {
+        *out = v;
+        return 1;
+    }
+    const char *u = strchr(units, *end);
+    if (!u || end[1] != '\0') return 0;
+    *out = v * seconds[u - units];
+    return 1;
+}
+
+int builtin_cache(char **argv) {
+    long ttl = CACHE_DEFAULT_TTL;
+    const char *env[MAX_KEY_ENV];
+    int nenv = 0;
+    char **files = NULL;
+    int nfiles = 0;
+    int i = 1;
+    for (; argv[i] && argv[i][0] == '-'; i++) {
+        char *a = argv[i];
+        if (strcmp(a, "-t") == 0) {
+            if (!ttl_arg(argv[++i], &ttl)) return usage();
+        } else if (strcmp(a, "-e") == 0) {
+            if (!argv[i + 1] || nenv == MAX_KEY_ENV) return usage();
+            env[nenv++] = argv[++i];
+        } else if (strcmp(a, "--key-files") == 0) {
+            // no quoting in the shell, so the file list runs up to "--"
+            files = &argv[i + 1];
+            while (argv[i + 1] && strcmp(argv[i + 1], "--") != 0) i++;
+            if (!argv[i + 1]) return usage();
+            nfiles = (int)(&argv[i + 1] - files);
+            i++;
+        } else {
+            return usage();
+        }
+    }
+    if (!argv[i]) return usage();
+    char **cmd = &argv[i];
+
+    struct buf key = {0};
+    char cwd[4096];
+    for (int k = 0; cmd[k]; k++) key_field(&key, cmd[k]);
+    key_field(&key, "");
+    key_field(&key, getcwd(cwd, sizeof(cwd)) ? cwd : "?");
+    for (size_t k = 0; k < sizeof(base_env) / sizeof(base_env[0]); k++) key_env(&key, base_env[k]);
+    for (int k = 0; k < nenv; k++) key_env(&key, env[k]);
+    for (int k = 0; k < nfiles; k++) key_file(&key, files[k]);
+
+    char dir[4096], path[4200], tmp[4300];
+    int status, complete = 0;
+    if (key.failed || store_dir(dir, sizeof(dir)) < 0) {
+        // nowhere to keep it, so just run it
+        free(key.data);
+        return run_and_capture(cmd, -1, &(struct entry_header){0}, &complete);
+    }
+    snprintf(path, sizeof(path), "%s/%016llx", dir, (unsigned long long)fnv1a(key.data, key.len));
+    if ((status = replay(path, &key, ttl)) >= 0) {
+        free(key.data);
+        return status;
+    }
+
+    // written under a temporary name and renamed into place once complete,
+    // so another shell never replays half an entry
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    int store = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    struct entry_header h = { ENTRY_MAGIC, (int64_t)time(NULL), 0, (uint32_t)key.len, 0, 0 };
+    if (store >= 0 && (write_all(store, (char *)&h, sizeof(h)) < 0 || write_all(store, key.data, key.len) < 0)) {
+        close(store);
+        unlink(tmp);
+        store = -1;
+    }
+    free(key.data);
+    status = run_and_capture(cmd, store, &h, &complete);
+    if (store >= 0) {
+        close(store);
+        if (complete && rename(tmp, path) == 0) {
+            evict(dir);
+        } else {
+            unlink(tmp);
+        }
+    }
+    return status;
+}
@@ -0,0 +1,20 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+// output memoization for the cache builtin (builtins.h):
+//   cache [-t ttl] [-e NAME]... [--key-files file... --] cmd...
+// the key is argv, the working directory, a few environment variables (PATH,
+// LANG, LC_ALL and each -e NAME) and the identity and mtime of every key file,
+// hashed with FNV-1a; the entry for it holds cmd's stdout, stderr and exit
+// status, so a hit replays them without running anything
+// entries live in $XDG_CACHE_HOME/yash (~/.cache/yash), one file per key,
+// and the least recently used go once the directory is over its size cap
+
+#define CACHE_DEFAULT_TTL 600           // seconds an entry stays valid without -t
+#define CACHE_DEFAULT_MAX (64L << 20)   // size cap on the store, bytes
+
+// size cap from "set -o cachesize=MB"
+void cache_set_max_size(long bytes);
+long cache_get_max_size(void);
+
+#endif /* CACHE_H */
@@ -0,0 +1,360 @@
+#define _GNU_SOURCE
+#include "cgroup.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+#ifndef CLONE_PARENT
+#define CLONE_PARENT 0x00008000
+#endif
+
+// clone3() arguments up to the cgroup field (CLONE_ARGS_SIZE_VER2)
+struct clone_args_v2 {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
+
+// limits written into each new job's cgroup; NULL = leave the kernel default
+enum { KNOB_CPU, KNOB_MEMORY, KNOB_IO, NKNOBS };
+static const char *knob_names[NKNOBS] = { "cpu.max", "memory.max", "io.max" };
+static const char *knob_ctrls[NKNOBS] = { "cpu", "memory", "io" }; // the controller each needs
+static char *knobs[NKNOBS];
+static int knob_warned[NKNOBS]; // complain once per setting, not once per job
+
+static int enabled = 0;
+static char *session = NULL;    // <mount><own cgroup>/yash.<pid>, the shell is in its shell/
+static char *home = NULL;       // <mount><own cgroup>, where the shell goes back on exit
+static int next_job = 1;
+
+/* ---------- small file helpers ---------- */
+
+static int write_file(const char *dir, const char *name, const char *val) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = write(fd, val, strlen(val));
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return n < 0 ? -1 : 0;
+}
+
+// first line of a file, "" if it can't be read
+static void read_line(const char *path, char *buf, size_t size) {
+    buf[0] = '\0';
+    FILE *f = fopen(path, "re");
+    if (!f) return;
+    if (!fgets(buf, (int)size, f)) buf[0] = '\0';
+    fclose(f);
+    buf[strcspn(buf, "\n")] = '\0';
+}
+
+static void job_dir(int cg, char *buf, size_t size) {
+    snprintf(buf, size, "%s/job.%d", session, cg);
+}
+
+/* ---------- session setup ---------- */
+
+// where the cgroup v2 hierarchy is mounted, from /proc/self/mountinfo
+static int find_mount(char *buf, size_t size) {
+    FILE *f = fopen("/proc/self/mountinfo", "re");
+    if (!f) return -1;
+    char line[4096];
+    int found = -1;
+    while (found < 0 && fgets(line, sizeof(line), f)) {
+        // id parent maj:min root mountpoint opts... - fstype source superopts
+        char *sep = strstr(line, " - ");
+        if (!sep || strncmp(sep + 3, "cgroup2 ", 8) != 0) continue;
+        char mnt[4096];
+        if (sscanf(line, "%*s %*s %*s %*s %4095s", mnt) == 1) {
+            snprintf(buf, size, "%s", mnt);
+            found = 0;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+// 1 if the space-separated list in file dir/name has word
+static int list_has(const char *dir, const char *name, const char *word) {
+    char path[4300], line[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    read_line(path, line, sizeof(line));
+    size_t len = strlen(word);
+    for (char *p = line; (p = strstr(p, word)) != NULL; p += len) {
+        if ((p == line || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) return 1;
+    }
+    return 0;
+}
+
+// whether job cgroups get the knob's controller; complains if not
+static int knob_usable(int k) {
+    if (list_has(session, "cgroup.subtree_control", knob_ctrls[k])) return 1;
+    fprintf(stderr, "cgroups: %s: no %s controller in %s (not delegated to the shell's cgroup?)\n",
+            knob_names[k], knob_ctrls[k], session);
+    return 0;
+}
+
+// undoes a session_start() that got partway
+static void session_abort(void) {
+    char path[4200];
+    snprintf(path, sizeof(path), "%s/shell", session);
+    rmdir(path);
+    rmdir(session);
+    free(session);
+    free(home);
+    session = home = NULL;
+}
+
+static int session_start(void) {
+    char mnt[2048], own[2048], base[4096];
+    if (find_mount(mnt, sizeof(mnt)) < 0) {
+        fprintf(stderr, "cgroups: no cgroup v2 hierarchy mounted\n");
+        return -1;
+    }
+    // "0::/path" is our place in the v2 hierarchy
+    own[0] = '\0';
+    FILE *f = fopen("/proc/self/cgroup", "re");
+    if (f) {
+        char line[2048];
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, "0::", 3) == 0) {
+                line[strcspn(line, "\n")] = '\0';
+                snprintf(own, sizeof(own), "%s", line + 3);
+                break;
+            }
+        }
+        fclose(f);
+    }
+    if (!own[0]) {
+        fprintf(stderr, "cgroups: shell is not in a cgroup v2 hierarchy\n");
+        return -1;
+    }
+    snprintf(base, sizeof(base), "%s%s", mnt, strcmp(own, "/") == 0 ? "" : own);
+
+    char path[4200];
+    snprintf(path, sizeof(path), "%s/yash.%d", base, (int)getpid());
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "cgroups: %s: %s (no delegated subtree?)\n", path, strerror(errno));
+        return -1;
+    }
+    session = strdup(path);
+    home = strdup(base);
+    if (!session || !home) {
+        free(session);
+        free(home);
+        session = home = NULL;
+        rmdir(path);
+        return -1;
+    }
+
+    // a cgroup with processes of its own can't hand controllers down, so the
+    // shell moves to a leaf of the session and the session itself stays empty
+    snprintf(path, sizeof(path), "%s/shell", session);
+    if ((mkdir(path, 0755) < 0 && errno != EEXIST) || write_file(path, "cgroup.procs", "0") < 0) {
+        fprintf(stderr, "cgroups: moving the shell to %s: %s\n", path, strerror(errno));
+        session_abort();
+        return -1;
+    }
+
+    // jobs get whichever of cpu, memory and io the session has; the parent is
+    // left alone, a limit needing a controller it doesn't delegate fails when set
+    for (int k = 0; k < NKNOBS; k++) {
+        if (!list_has(session, "cgroup.controllers", knob_ctrls[k])) continue;
+        char op[16];
+        snprintf(op, sizeof(op), "+%s", knob_ctrls[k]);
+        if (write_file(session, "cgroup.subtree_control", op) < 0) {
+            fprintf(stderr, "cgroups: enabling %s: %s\n", knob_ctrls[k], strerror(errno));
+        }
+    }
+    return 0;
+}
+
+/* ---------- options ---------- */
+
+int cgroup_set_option(const char *name, const char *value) {
+    if (strcmp(name, "cgroups") == 0) {
+        if (strcmp(value, "on") == 0) {
+            if (!session && session_start() < 0) return -1;
+            // limits set before now have to be enforceable too
+            for (int k = 0; k < NKNOBS; k++) {
+                if (knobs[k] && !knob_usable(k)) return -1;
+            }
+            enabled = 1;
+        } else if (strcmp(value, "off") == 0) {
+            enabled = 0; // running jobs keep their cgroups
+        } else {
+            fprintf(stderr, "set: cgroups: expected on or off\n");
+            return -1;
+        }
+        return 1;
+    }
+    for (int k = 0; k < NKNOBS; k++) {
+        if (strcmp(name, knob_names[k]) != 0) continue;
+        if (strcmp(value, "none") == 0) {
+            free(knobs[k]);
+            knobs[k] = NULL;
+            return 1;
+        }
+        char *v = strdup(value);
+        if (!v) return -1;
+        if (session && !knob_usable(k)) {
+            free(v);
+            return -1;
+        }
+        // no quoting in the shell, so "50000,100000" means "50000 100000"
+        for (char *p = v; *p; p++) {
+            if (*p == ',') *p = ' ';
+        }
+        free(knobs[k]);
+        knobs[k] = v;
+        knob_warned[k] = 0;
+        return 1;
+    }
+    return 0;
+}
+
+void cgroup_print_options(void) {
+    printf("cgroups=%s\n", enabled ? "on" : "off");
+    for (int k = 0; k < NKNOBS; k++) {
+        printf("%s=", knob_names[k]);
+        for (const char *p = knobs[k] ? knobs[k] : ""; *p; p++) {
+            putchar(*p == ' ' ? ',' : *p);
+        }
+        putchar('\n');
+    }
+}
+
+/* ---------- jobs ---------- */
+
+int cgroup_job_create(int *fd_out) {
+    *fd_out = -1;
+    if (!enabled) return -1;
+
+    int cg = next_job++;
+    char dir[4200];
+    job_dir(cg, dir, sizeof(dir));
+    if (mkdir(dir, 0755) < 0) return -1;
+
+    for (int k = 0; k < NKNOBS; k++) {
+        if (!knobs[k] || write_file(dir, knob_names[k], knobs[k]) == 0) continue;
+        if (!knob_warned[k]) {
+            fprintf(stderr, "cgroups: %s: %s\n", knob_names[k], strerror(errno));
+            knob_warned[k] = 1;
+        }
+    }
+
+    // clone3 wants a real directory fd, O_PATH isn't enough
+    *fd_out = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (*fd_out < 0) {
+        rmdir(dir);
+        return -1;
+    }
+    return cg;
+}
+
+void cgroup_job_destroy(int cg) {
+    if (cg < 0 || !session) return;
+    char dir[4200];
+    job_dir(cg, dir, sizeof(dir));
+    rmdir(dir); // EBUSY if something escaped the job and still runs; cleanup retries
+}
+
+int cgroup_job_kill(int cg) {
+    if (cg < 0 || !session) return -1;
+    char dir[4200];
+    job_dir(cg, dir, sizeof(dir));
+    return write_file(dir, "cgroup.kill", "1");
+}
+
+// "some avg10=" of a pressure file, -1 if unavailable
+static double read_pressure(const char *dir, const char *name) {
+    char path[4300], line[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    read_line(path, line, sizeof(line));
+    double v;
+    if (sscanf(line, "some avg10=%lf", &v) != 1) return -1;
+    return v;
+}
+
+int cgroup_job_stats(int cg, struct cgroup_stats *st) {
+    st->memory_current = -1;
+    st->cpu_some = st->memory_some = st->io_some = -1;
+    if (cg < 0 || !session) return -1;
+
+    char dir[4200], path[4300], line[64];
+    job_dir(cg, dir, sizeof(dir));
+    snprintf(path, sizeof(path), "%s/memory.current", dir);
+    read_line(path, line, sizeof(line));
+    if (line[0]) st->memory_current = atoll(line);
+    st->cpu_some = read_pressure(dir, "cpu.pressure");
+    st->memory_some = read_pressure(dir, "memory.pressure");
+    st->io_some = read_pressure(dir, "io.pressure");
+    return 0;
+}
+
+pid_t cgroup_clone(int cgfd, int parent) {
+    struct clone_args_v2 args;
+    memset(&args, 0, sizeof(args));
+    args.flags = CLONE_INTO_CGROUP | (parent ? CLONE_PARENT : 0);
+    args.exit_signal = SIGCHLD;
+    args.cgroup = (uint64_t)cgfd;
+    pid_t pid = (pid_t)syscall(SYS_clone3, &args, sizeof(args));
+    // EINVAL: 5.3 to 5.6 have clone3 but not CLONE_INTO_CGROUP
+    if (pid >= 0 || (errno != ENOSYS && errno != E2BIG && errno != EINVAL)) return pid;
+
+    // no clone3 (or no CLONE_INTO_CGROUP): the child moves itself in before
+    // it does anything else, which is just as good for a process about to exec
+    pid = (pid_t)syscall(SYS_clone, (parent ? CLONE_PARENT : 0) | SIGCHLD, NULL, NULL, NULL, 0);
+    if (pid == 0) {
+        int fd = openat(cgfd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || write(fd, "0", 1) < 0) _exit(126);
+        close(fd);
+    }
+    return pid;
+}
+
+void cgroup_cleanup(void) {
+    if (!session) return;
+    DIR *d = opendir(session);
+    if (d) {
+        struct dirent *e;
+        while ((e = readdir(d)) != NULL) {
+            if (strncmp(e->d_name, "job.", 4) != 0) continue;
+            char dir[4500];
+            snprintf(dir, sizeof(dir), "%s/%s", session, e->d_name);
+            rmdir(dir);
+        }
+        closedir(d);
+    }
+    // back where it started, so its leaf can go too
+    char leaf[4200];
+    snprintf(leaf, sizeof(leaf), "%s/shell", session);
+    write_file(home, "cgroup.procs", "0");
+    rmdir(leaf);
+    rmdir(session); // stays behind if a job is still running, like its processes
+    free(session);
+    free(home);
+    session = home = NULL;
+}
@@ -0,0 +1,47 @@
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <sys/types.h>
+
+// per-job cgroup v2 placement, off until "set -o cgroups=on"
+// the shell makes <its cgroup>/yash.<pid>/, moves itself into shell/ below it
+// and every job gets job.<n> beside that, so the session needs a delegated
+// (writable) cgroup v2 subtree; a limit whose controller isn't delegated is an error
+
+// "set -o" settings: cgroups=on|off, cpu.max=..., memory.max=..., io.max=...
+// (commas in a value stand for spaces, e.g. cpu.max=50000,100000; "none" unsets one)
+// returns 1 if handled, 0 if name isn't a cgroup option, -1 on a bad value
+int cgroup_set_option(const char *name, const char *value);
+void cgroup_print_options(void);
+
+// makes a cgroup for a new job with the current limits written to it
+// returns its number and an O_DIRECTORY fd for cgroup_clone() in *fd_out
+// (the caller closes it), or -1 (and *fd_out = -1) when cgroups are off or it failed
+int cgroup_job_create(int *fd_out);
+
+// removes a job's cgroup once its processes are gone (no-op for -1)
+void cgroup_job_destroy(int cg);
+
+// kills every process in the job's cgroup (cgroup.kill), even ones that left
+// the process group; returns 0 on success, -1 if the kernel can't
+int cgroup_job_kill(int cg);
+
+// live numbers for "jobs -l"; fields are -1 where the kernel doesn't provide them
+struct cgroup_stats {
+    long long memory_current;   // bytes
+    double cpu_some;            // PSI "some avg10", percent
+    double memory_some;
+    double io_some;
+};
+int cgroup_job_stats(int cg, struct cgroup_stats *st);
+
+// fork() that starts the child inside the cgroup of cgfd with
+// clone3(CLONE_INTO_CGROUP), so it never runs a single instruction outside it;
+// with parent set the child becomes our parent's child (CLONE_PARENT)
+// falls back to clone + moving itself in on kernels without clone3
+pid_t cgroup_clone(int cgfd, int parent);
+
+// removes the session's empty cgroups, called when the shell exits
+void cgroup_cleanup(void);
+
+#endif /* CGROUP_H */
@@ -0,0 +1,283 @@
+#define _GNU_SOURCE
+#include "coproc.h"
+#include "builtins.h"
+#include "exec.h"
+#include "eval.h"
+#include "jobs.h"
+#include "cgroup.h"
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define FD_MIN 10       // above the fds users redirect by number, like redir.c's saved copies
+#define PEEK_CHUNK 4096
+
+struct coproc {
+    char *name;         // NULL: free entry
+    pid_t pid;
+    int fd;             // the shell's end of the socketpair
+    int writable;       // 0 after "coproc close"
+};
+
+static struct coproc procs[MAX_COPROCS];
+
+static struct coproc *find(const char *name) {
+    for (int i = 0; i < MAX_COPROCS; i++) {
+        if (procs[i].name && strcmp(procs[i].name, name) == 0) return &procs[i];
+    }
+    return NULL;
+}
+
+int coproc_fd(const char *name, int to_it) {
+    struct coproc *c = find(name);
+    if (!c || (to_it && !c->writable)) return -1;
+    return c->fd;
+}
+
+// still in the job table and not DONE
+static int running(const struct coproc *c) {
+    char spec[16];
+    snprintf(spec, sizeof(spec), "%d", (int)c->pid);
+    int slot = jobs_find(spec);
+    return slot >= 0 && jobs_exit_status(slot) < 0;
+}
+
+static void forget(struct coproc *c) {
+    close(c->fd);
+    free(c->name);
+    memset(c, 0, sizeof(*c));
+}
+
+// waits for fd to be ready; 0 when it is, 128+SIGINT if ctrl-c came first
+// (SA_RESTART would restart a blocked read, but never poll)
+static int wait_fd(int fd, short events) {
+    struct pollfd p = { fd, events, 0 };
+    while (poll(&p, 1, -1) < 0) {
+        if (errno != EINTR) return 1;
+        if (eval_interrupted()) return 128 + SIGINT;
+    }
+    return 0;
+}
+
+/* ---------- coproc NAME cmd... ---------- */
+
+static int start(char **argv) {
+    const char *name = argv[1];
+    if (!vars_valid_name(name, strlen(name)) || strcmp(name, "send") == 0 || strcmp(name, "recv") == 0 ||
+        strcmp(name, "close") == 0) {
+        fprintf(stderr, "coproc: %s: bad name\n", name);
+        return 2;
+    }
+    struct coproc *c = find(name);
+    if (c && running(c)) {
+        fprintf(stderr, "coproc: %s is already running\n", name);
+        return 1;
+    }
+    if (c) forget(c); // a finished one gives its name up
+    for (int i = 0; i < MAX_COPROCS && !c; i++) {
+        if (!procs[i].name) c = &procs[i];
+    }
+    if (!c) {
+        fprintf(stderr, "coproc: too many coprocesses (%d)\n", MAX_COPROCS);
+        return 1;
+    }
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("coproc");
+        return 1;
+    }
+    int fd = fcntl(sv[0], F_DUPFD_CLOEXEC, FD_MIN);
+    close(sv[0]);
+
+    // "coproc NAME cmd..." is what jobs shows
+    size_t len = 1;
+    for (int i = 0; argv[i]; i++) len += strlen(argv[i]) + 1;
+    char *text = malloc(len);
+    if (fd < 0 || !text) {
+        if (fd >= 0) close(fd);
+        close(sv[1]);
+        free(text);
+        return 1;
+    }
+    text[0] = '\0';
+    for (int i = 0; argv[i]; i++) {
+        if (i) strcat(text, " ");
+        strcat(text, argv[i]);
+    }
+
+    // never queued by admission control, its channel is wanted right away
+    int cg;
+    pid_t pid = exec_start_background(&argv[2], NULL, 0, sv[1], sv[1], &cg);
+    close(sv[1]);
+    int jid = -1;
+    if (pid > 0) {
+        pid_t pids[1] = { pid };
+        jid = jobs_add(pid, pids, 1, text, RUNNING);
+        if (jid < 0) {
+            kill(-pid, SIGTERM);
+            waitpid(pid, NULL, 0);
+            cgroup_job_destroy(cg);
+        } else {
+            jobs_attach_cgroup(jid, cg);
+        }
+    }
+    free(text);
+    if (jid < 0) {
+        fprintf(stderr, "coproc: %s: could not start\n", argv[2]);
+        close(fd);
+        return 1;
+    }
+
+    c->name = strdup(name);
+    c->pid = pid;
+    c->fd = fd;
+    c->writable = 1;
+    if (!c->name) {
+        forget(c);
+        return 1;
+    }
+    return 0;
+}
+
+/* ---------- send / recv / close ---------- */
+
+static struct coproc *lookup(const char *cmd, const char *name) {
+    struct coproc *c = name ? find(name) : NULL;
+    if (!c) fprintf(stderr, "coproc %s: %s: no such coprocess\n", cmd, name ? name : "");
+    return c;
+}
+
+static int send_line(char **argv) {
+    struct coproc *c = lookup("send", argv[2]);
+    if (!c) return 1;
+    if (!c->writable) {
+        fprintf(stderr, "coproc send: %s: input is closed\n", c->name);
+        return 1;
+    }
+    size_t len = 1;
+    for (int i = 3; argv[i]; i++) len += strlen(argv[i]) + 1;
+    char *line = malloc(len);
+    if (!line) return 1;
+    size_t n = 0;
+    for (int i = 3; argv[i]; i++) {
+        size_t w = strlen(argv[i]);
+        if (i > 3) line[n++] = ' ';
+        memcpy(line + n, argv[i], w);
+        n += w;
+    }
+    line[n++] = '\n';
+
+    // MSG_NOSIGNAL: a worker that died is an error here, not a SIGPIPE for the shell
+    int status = 0;
+    for (size_t off = 0; off < n && status == 0;) {
+        if ((status = wait_fd(c->fd, POLLOUT)) != 0) break;
+        ssize_t w = send(c->fd, line + off, n - off, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (w < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (w < 0) {
+            fprintf(stderr, "coproc send: %s: %s\n", c->name, strerror(errno));
+            status = 1;
+            break;
+        }
+        off += w;
+    }
+    free(line);
+    return status;
+}
+
+// takes exactly one line off the channel: peeks for the newline and reads
+// only up to it, so whatever comes next stays for the next reader (another
+// recv, a "<&NAME" command or a $(...) subshell)
+static int recv_line(char **argv) {
+    struct coproc *c = lookup("recv", argv[2]);
+    if (!c) return 1;
+    if (argv[3] && (argv[4] || !vars_valid_name(argv[3], strlen(argv[3])))) {
+        fprintf(stderr, "coproc: usage: coproc recv NAME [VAR]\n");
+        return 2;
+    }
+
+    char chunk[PEEK_CHUNK];
+    char *line = NULL;
+    size_t len = 0;
+    int status = 0, done = 0;
+    while (!done) {
+        if ((status = wait_fd(c->fd, POLLIN)) != 0) break;
+        ssize_t n = recv(c->fd, chunk, sizeof(chunk), MSG_PEEK | MSG_DONTWAIT);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n <= 0) {
+            // EOF: a last line without its newline still counts
+            status = len > 0 ? 0 : 1;
+            break;
+        }
+        char *nl = memchr(chunk, '\n', n);
+        if (nl) {
+            n = nl - chunk + 1;
+            done = 1;
+        }
+        n = recv(c->fd, chunk, n, 0); // what the peek saw, so this can't block
+        if (n <= 0) {
+            status = 1;
+            break;
+        }
+        char *grown = realloc(line, len + n + 1);
+        if (!grown) {
+            status = 1;
+            break;
+        }
+        line = grown;
+        memcpy(line + len, chunk, n);
+        len += n;
+    }
+    if (status == 0) {
+        if (len > 0 && line[len - 1] == '\n') len--;
+        line[len] = '\0';
+        if (argv[3]) {
+            status = vars_set(argv[3], line, 0) < 0 ? 1 : 0;
+        } else {
+            printf("%s\n", line);
+        }
+    }
+    free(line);
+    return status;
+}
+
+static int close_input(char **argv) {
+    struct coproc *c = lookup("close", argv[2]);
+    if (!c) return 1;
+    if (c->writable) shutdown(c->fd, SHUT_WR);
+    c->writable = 0;
+    return 0;
+}
+
+static void list(void) {
+    for (int i = 0; i < MAX_COPROCS; i++) {
+        struct coproc *c = &procs[i];
+        if (!c->name) continue;
+        printf("%s\t%d\t%s%s\n", c->name, (int)c->pid, running(c) ? "Running" : "Done",
+               c->writable ? "" : ", input closed");
+    }
+}
+
+int builtin_coproc(char **argv) {
+    if (!argv[1]) {
+        list();
+        return 0;
+    }
+    int sub = strcmp(argv[1], "send") == 0 || strcmp(argv[1], "recv") == 0 || strcmp(argv[1], "close") == 0;
+    if (!argv[2] || (sub && argv[1][0] == 'c' && argv[3])) {
+        fprintf(stderr, "coproc: usage: coproc [NAME cmd... | send NAME words... | recv NAME [VAR] | close NAME]\n");
+        return 2;
+    }
+    if (!sub) return start(argv);
+    if (argv[1][0] == 's') return send_line(argv);
+    if (argv[1][0] == 'r') return recv_line(argv);
+    return close_input(argv);
+}
@@ -0,0 +1,20 @@
+#ifndef COPROC_H
+#define COPROC_H
+
+// coprocesses: long-lived workers started once and then fed from the prompt
+//   coproc                      lists them
+//   coproc NAME cmd...          starts cmd as a background job
+//   coproc send NAME words...   writes the words and a newline to its stdin
+//   coproc recv NAME [VAR]      reads one line of its stdout, into VAR or printed
+//   coproc close NAME           ends its stdin (it sees EOF, its output stays readable)
+// cmd's stdin and stdout are both one end of a socketpair, the shell holds
+// the other (close-on-exec), and any command can use it with "n>&NAME"
+// (to its stdin) or "n<&NAME" (from its stdout)
+
+#define MAX_COPROCS 16
+
+// the shell's end of NAME's channel, -1 if there is no such coprocess
+// to_it: 1 for writing to its stdin, 0 for reading its stdout
+int coproc_fd(const char *name, int to_it);
+
+#endif /* COPROC_H */
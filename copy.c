@@ -0,0 +1,357 @@
+#define _GNU_SOURCE
+#include "copy.h"
+#include "builtins.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+// bytes asked for per call; splice() and tee() stop at what the pipe holds
+#define CHUNK (1 << 20)
+#define RW_BUF (128 * 1024)
+
+/* ---------- moving data ---------- */
+
+enum method { COPY_RANGE, SPLICE, SENDFILE, READ_WRITE };
+
+// errors that mean "not with these fds", so the next method may still work
+static int refused(int err) {
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EBADF || err == EOPNOTSUPP;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, buf, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += w;
+        len -= w;
+    }
+    return 0;
+}
+
+static char *rw_buf(void) {
+    static char *buf = NULL;
+    if (!buf) buf = malloc(RW_BUF);
+    return buf;
+}
+
+static ssize_t read_write(int in, int out) {
+    char *buf = rw_buf();
+    if (!buf) return -1;
+    ssize_t n = read(in, buf, RW_BUF);
+    if (n > 0 && write_all(out, buf, n) < 0) return -1;
+    return n;
+}
+
+// copies with one method until EOF; 0 when done, -1 on error, 1 when the
+// kernel refused the method (every call moves both offsets, so the next
+// method just carries on from there)
+static int move(int in, int out, enum method how) {
+    while (1) {
+        ssize_t n;
+        switch (how) {
+        case COPY_RANGE:
+            n = copy_file_range(in, NULL, out, NULL, CHUNK, 0);
+            break;
+        case SPLICE:
+            n = splice(in, NULL, out, NULL, CHUNK, SPLICE_F_MOVE);
+            break;
+        case SENDFILE:
+            n = sendfile(out, in, NULL, CHUNK);
+            break;
+        default:
+            n = read_write(in, out);
+            break;
+        }
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return refused(errno) && how != READ_WRITE ? 1 : -1;
+        }
+    }
+}
+
+int copy_fd(int in, int out) {
+    struct stat si, so;
+    if (fstat(in, &si) < 0 || fstat(out, &so) < 0) return -1;
+
+    // /proc and /sys files say they are empty and only give their data to read()
+    int sized = S_ISREG(si.st_mode) && si.st_size > 0;
+    int rc = 1;
+    if (sized && S_ISREG(so.st_mode)) {
+        rc = move(in, out, COPY_RANGE); // in-kernel, a reflink on filesystems that have them
+    }
+    // splice() needs a pipe on one end (and not one of those empty-looking files)
+    if (rc > 0 && (S_ISFIFO(si.st_mode) || (S_ISFIFO(so.st_mode) && (sized || !S_ISREG(si.st_mode))))) {
+        rc = move(in, out, SPLICE);
+    }
+    if (rc > 0 && sized) {
+        rc = move(in, out, SENDFILE);
+    }
+    if (rc > 0) {
+        rc = move(in, out, READ_WRITE);
+    }
+    return rc;
+}
+
+/* ---------- tee ---------- */
+
+static int is_fifo(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+// splice() writes to pipes, sockets and files, but not to files in append mode
+static int splice_target(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) return 0;
+    if (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode)) return 1;
+    return S_ISREG(st.st_mode) && !(fcntl(fd, F_GETFL) & O_APPEND);
+}
+
+static int splice_all(int in, int out, size_t len) {
+    while (len > 0) {
+        ssize_t n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n == 0) errno = EPIPE;
+            return -1;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+// stdin (a pipe) to every output without the data leaving the kernel: each
+// round tee()s what stdin holds to all outputs but the last, through a
+// private pipe where an output isn't a pipe itself, and splice()s it to the
+// last, which consumes it; 1 if this can't be done with these fds
+static int tee_spliced(int in, const int *outs, int n) {
+    for (int k = 0; k < n; k++) {
+        if (!splice_target(outs[k])) return 1;
+    }
+    int size = fcntl(in, F_GETPIPE_SZ);
+    if (size < 0) return 1;
+
+    int (*priv)[2] = malloc(sizeof(*priv) * n);
+    if (!priv) return -1;
+    int rc = 0;
+    for (int k = 0; k < n; k++) {
+        priv[k][0] = priv[k][1] = -1;
+    }
+    // only the first output may be a pipe someone else is draining: after it
+    // every tee() has to take the whole round, so it goes to an empty pipe
+    // at least as big as stdin's
+    for (int k = 0; k < n - 1 && rc == 0; k++) {
+        if (k == 0 && is_fifo(outs[k])) continue;
+        if (pipe2(priv[k], O_CLOEXEC) < 0) {
+            rc = -1;
+        } else if (fcntl(priv[k][1], F_GETPIPE_SZ) < size &&
+                   fcntl(priv[k][1], F_SETPIPE_SZ, size) < size) {
+            rc = 1;
+        }
+    }
+
+    int started = 0;
+    while (rc == 0) {
+        ssize_t len = tee(in, priv[0][1] >= 0 ? priv[0][1] : outs[0], CHUNK, 0);
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) {
+            if (len < 0) rc = !started && refused(errno) ? 1 : -1;
+            break;
+        }
+        started = 1;
+        if (priv[0][0] >= 0 && splice_all(priv[0][0], outs[0], len) < 0) rc = -1;
+        for (int k = 1; k < n - 1 && rc == 0; k++) {
+            ssize_t m;
+            while ((m = tee(in, priv[k][1], len, 0)) < 0 && errno == EINTR) continue;
+            if (m != len || splice_all(priv[k][0], outs[k], len) < 0) {
+                if (m >= 0 && m != len) errno = EIO;
+                rc = -1;
+            }
+        }
+        if (rc == 0 && splice_all(in, outs[n - 1], len) < 0) rc = -1;
+    }
+
+    for (int k = 0; k < n; k++) {
+        if (priv[k][0] >= 0) close(priv[k][0]);
+        if (priv[k][1] >= 0) close(priv[k][1]);
+    }
+    free(priv);
+    return rc;
+}
+
+static int tee_copied(int in, const int *outs, int n) {
+    char *buf = rw_buf();
+    if (!buf) return -1;
+    while (1) {
+        ssize_t len = read(in, buf, RW_BUF);
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) return (int)len;
+        for (int k = 0; k < n; k++) {
+            if (write_all(outs[k], buf, len) < 0) return -1;
+        }
+    }
+}
+
+/* ---------- builtins ---------- */
+
+// these run in the job's own process, never in the shell (BUILTIN_NOEXEC),
+// so an option they don't handle can still go to the real program
+static int exec_real(char **argv) {
+    execvp(argv[0], argv);
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+    return 127;
+}
+
+static int has_options(char **argv, const char *ours) {
+    for (int i = 1; argv[i]; i++) {
+        if (argv[i][0] != '-' || argv[i][1] == '\0') continue;
+        if (!ours || strcmp(argv[i], ours) != 0) return 1;
+    }
+    return 0;
+}
+
+static int same_file(const struct stat *a, const struct stat *b) {
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino;
+}
+
+// cat [file...], "-" or nothing reads stdin
+int builtin_cat(char **argv) {
+    if (has_options(argv, NULL)) return exec_real(argv);
+
+    struct stat so;
+    int out_is_file = fstat(STDOUT_FILENO, &so) == 0 && S_ISREG(so.st_mode);
+    int status = 0;
+    for (int i = 1; i == 1 || argv[i]; i++) {
+        const char *name = argv[i] ? argv[i] : "-";
+        int fd = strcmp(name, "-") == 0 ? STDIN_FILENO : open(name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            status = 1;
+            continue;
+        }
+        struct stat si;
+        if (out_is_file && fstat(fd, &si) == 0 && same_file(&si, &so)) {
+            fprintf(stderr, "cat: %s: input file is output file\n", name); // or it never ends
+            status = 1;
+        } else if (copy_fd(fd, STDOUT_FILENO) < 0) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            status = 1;
+        }
+        if (fd != STDIN_FILENO) close(fd);
+        if (!argv[i]) break;
+    }
+    return status;
+}
+
+// tee [-a] [file...]
+int builtin_tee(char **argv) {
+    if (has_options(argv, "-a")) return exec_real(argv);
+
+    int n = 0;
+    while (argv[n]) n++;
+    int *outs = malloc(sizeof(int) * (n + 1));
+    if (!outs) return 1;
+    int nouts = 0, status = 0, append = 0;
+    outs[nouts++] = STDOUT_FILENO;
+    for (int i = 1; argv[i]; i++) {
+        if (strcmp(argv[i], "-a") == 0) {
+            append = 1;
+            continue;
+        }
+        // O_APPEND keeps other writers of a shared log intact; it also keeps
+        // splice() out, so -a takes the read/write path (splice_target)
+        int fd = open(argv[i], O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0666);
+        if (fd < 0) {
+            fprintf(stderr, "tee: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        outs[nouts++] = fd;
+    }
+
+    int rc;
+    if (nouts == 1) {
+        rc = copy_fd(STDIN_FILENO, STDOUT_FILENO);
+    } else {
+        rc = is_fifo(STDIN_FILENO) ? tee_spliced(STDIN_FILENO, outs, nouts) : 1;
+        if (rc > 0) rc = tee_copied(STDIN_FILENO, outs, nouts);
+    }
+    if (rc < 0) {
+        fprintf(stderr, "tee: %s\n", strerror(errno));
+        status = 1;
+    }
+    for (int k = 1; k < nouts; k++) close(outs[k]);
+    free(outs);
+    return status;
+}
+
+static int copy_file(const char *src, const char *dst) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    struct stat si, sd;
+    if (in < 0 || fstat(in, &si) < 0) {
+        fprintf(stderr, "cp: %s: %s\n", src, strerror(errno));
+        if (in >= 0) close(in);
+        return -1;
+    }
+    if (S_ISDIR(si.st_mode)) {
+        fprintf(stderr, "cp: %s: is a directory\n", src);
+        close(in);
+        return -1;
+    }
+    if (stat(dst, &sd) == 0 && same_file(&si, &sd)) {
+        fprintf(stderr, "cp: %s and %s are the same file\n", src, dst);
+        close(in);
+        return -1;
+    }
+
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, si.st_mode & 0777);
+    int rc = out < 0 ? -1 : copy_fd(in, out);
+    if (rc < 0) fprintf(stderr, "cp: %s: %s\n", out < 0 ? dst : src, strerror(errno));
+    if (out >= 0 && close(out) < 0 && rc == 0) {
+        fprintf(stderr, "cp: %s: %s\n", dst, strerror(errno));
+        rc = -1;
+    }
+    close(in);
+    return rc;
+}
+
+// cp src dst, or cp src... dir
+int builtin_cp(char **argv) {
+    if (has_options(argv, NULL)) return exec_real(argv);
+
+    int argc = 0;
+    while (argv[argc]) argc++;
+    if (argc < 3) {
+        fprintf(stderr, "cp: usage: cp src dst | cp src... dir\n");
+        return 2;
+    }
+    const char *last = argv[argc - 1];
+    struct stat st;
+    int to_dir = stat(last, &st) == 0 && S_ISDIR(st.st_mode);
+    if (argc > 3 && !to_dir) {
+        fprintf(stderr, "cp: %s: not a directory\n", last);
+        return 1;
+    }
+
+    int status = 0;
+    for (int i = 1; i < argc - 1; i++) {
+        char path[4096];
+        const char *dst = last;
+        if (to_dir) {
+            const char *base = strrchr(argv[i], '/');
+            snprintf(path, sizeof(path), "%s/%s", last, base ? base + 1 : argv[i]);
+            dst = path;
+        }
+        if (copy_file(argv[i], dst) < 0) status = 1;
+    }
+    return status;
+}
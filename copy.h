@@ -0,0 +1,13 @@
+#ifndef COPY_H
+#define COPY_H
+
+// moving bytes between fds without a trip through user space where the kernel
+// can: copy_file_range() file to file, splice() when either end is a pipe,
+// sendfile() from a file, read()/write() for everything else (ttys, /proc, ...)
+// these back the cat, tee and cp builtins (builtins.h)
+
+// copies everything from in (up to EOF) to out, from and advancing both
+// current offsets; returns 0 on success, -1 on error with errno set
+int copy_fd(int in, int out);
+
+#endif /* COPY_H */
@@ -0,0 +1,550 @@
+#include "eval.h"
+#include "builtins.h"
+#include "exec.h"
+#include "jobs.h"
+#include "redir.h"
+#include "vars.h"
+#include "pathexp.h"
+#include "cgroup.h"
+#include "cache.h"
+#include "topo.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+static int last_status = 0;
+
+// pending break/continue count, unwound by the enclosing loops
+static int break_levels = 0;
+static int continue_levels = 0;
+static int loop_depth = 0;
+
+// set by SIGINT while the shell itself is running (e.g. a builtin-only loop)
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_sigint(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+int eval_last_status(void) {
+    return last_status;
+}
+
+int eval_interrupted(void) {
+    return interrupted;
+}
+
+// jobs [-l]
+int builtin_jobs(char **argv) {
+    int verbose = argv[1] && strcmp(argv[1], "-l") == 0;
+    jobs_print(verbose);
+    return 0;
+}
+
+int builtin_fg(char **argv) {
+    (void)argv;
+    pid_t pgid; 
+    job_state_t st; 
+    const char *cmdtxt; 
+    int slot;
+    if (jobs_get_current(&pgid, &st, &cmdtxt, &slot) == 0) {
+        exec_foreground_job(pgid, slot, st, cmdtxt);
+        return exec_last_status();
+    }
+    // no current job
+    putchar('\n');
+    return 1;
+}
+
+int builtin_bg(char **argv) {
+    (void)argv;
+    pid_t pgid; 
+    int slot; 
+    const char *txt; 
+    int id;
+    if (jobs_get_current_stopped(&pgid, &slot, &txt, &id) == 0) {
+        // resume in background and send SIGCONT to the whole process group
+        kill(-pgid, SIGCONT);
+        jobs_mark_running(slot);
+        printf("[%d]+  Running  %s \n", id, txt);
+        return 0;
+    }
+    //nothing to bg
+    putchar('\n');
+    return 1;
+}
+
+// break/continue take an optional loop count, like sh
+static int builtin_loop_jump(char **argv, int *levels) {
+    int n = 1;
+    if (argv[1]) {
+        n = atoi(argv[1]);
+        if (n < 1) return 1;
+    }
+    if (loop_depth == 0) return 0; // outside a loop it's a no-op
+    *levels = n > loop_depth ? loop_depth : n;
+    return 0;
+}
+
+int builtin_break(char **argv) {
+    return builtin_loop_jump(argv, &break_levels);
+}
+
+int builtin_continue(char **argv) {
+    return builtin_loop_jump(argv, &continue_levels);
+}
+
+int builtin_true(char **argv) {
+    (void)argv;
+    return 0;
+}
+
+int builtin_false(char **argv) {
+    (void)argv;
+    return 1;
+}
+
+// echo [-n] words...
+int builtin_echo(char **argv) {
+    int i = 1, newline = 1;
+    if (argv[1] && strcmp(argv[1], "-n") == 0) {
+        newline = 0;
+        i++;
+    }
+    for (int first = 1; argv[i]; i++, first = 0) {
+        if (!first) putchar(' ');
+        fputs(argv[i], stdout);
+    }
+    if (newline) putchar('\n');
+    return ferror(stdout) ? 1 : 0;
+}
+
+int builtin_pwd(char **argv) {
+    (void)argv;
+    char *cwd = getcwd(NULL, 0);
+    if (!cwd) {
+        perror("pwd");
+        return 1;
+    }
+    puts(cwd);
+    free(cwd);
+    return ferror(stdout) ? 1 : 0;
+}
+
+// export [NAME[=value]...], no args lists the exported variables
+int builtin_export(char **argv) {
+    if (!argv[1]) {
+        vars_print_exported();
+        return 0;
+    }
+    int status = 0;
+    for (int i = 1; argv[i]; i++) {
+        char *eq = strchr(argv[i], '=');
+        int rc;
+        if (eq) {
+            *eq = '\0';
+            rc = vars_set(argv[i], eq + 1, 1);
+            *eq = '=';
+        } else {
+            rc = vars_export(argv[i]);
+        }
+        if (rc < 0) status = 1;
+    }
+    return status;
+}
+
+// unset NAME...
+int builtin_unset(char **argv) {
+    for (int i = 1; argv[i]; i++) vars_unset(argv[i]);
+    return 0;
+}
+
+// wait [-n] [--all] [%N|pid ...]
+// no ids waits for every running job; -n returns as soon as one finishes
+int builtin_wait(char **argv) {
+    int any = 0, all = 0, i = 1;
+    for (; argv[i] && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-n") == 0) {
+            any = 1;
+        } else if (strcmp(argv[i], "--all") == 0) {
+            all = 1;
+        } else {
+            fprintf(stderr, "wait: usage: wait [-n] [--all] [%%N|pid ...]\n");
+            return 2;
+        }
+    }
+
+    int slots[JOBS_TABLE_SIZE];
+    int n = 0, explicit_ids = argv[i] != NULL, last_unknown = 0;
+    for (; argv[i]; i++) {
+        int slot = jobs_find(argv[i]);
+        last_unknown = slot < 0;
+        if (slot < 0) {
+            fprintf(stderr, "wait: %s: no such job\n", argv[i]);
+            continue;
+        }
+        if (n < JOBS_TABLE_SIZE) slots[n++] = slot;
+    }
+    if (!explicit_ids) {
+        n = jobs_running_slots(slots, JOBS_TABLE_SIZE);
+    }
+    if (n == 0) {
+        return (explicit_ids || any) ? 127 : 0;
+    }
+
+    int rc;
+    while ((rc = jobs_wait(slots, n, any)) == -2) {
+        if (interrupted) return 128 + SIGINT;
+    }
+    if (rc == -3) {
+        fprintf(stderr, "wait: a job is stopped (fg or bg it first)\n");
+        return 128 + SIGTSTP;
+    }
+
+    int status = 0;
+    if (any) {
+        status = rc >= 0 ? jobs_exit_status(rc) : 127;
+    } else if (explicit_ids) {
+        // like sh, the last id's status, 127 if that one wasn't a job
+        status = last_unknown ? 127 : jobs_exit_status(slots[n - 1]);
+    } else if (all) {
+        // --all reports the first failure, plain wait always succeeds
+        for (int j = 0; j < n && status == 0; j++) {
+            int st = jobs_exit_status(slots[j]);
+            if (st > 0) status = st;
+        }
+    }
+
+    // their status went to wait, so the next prompt doesn't announce them
+    if (any) {
+        if (rc >= 0) jobs_remove(rc);
+    } else {
+        for (int j = 0; j < n; j++) {
+            if (jobs_exit_status(slots[j]) >= 0) jobs_remove(slots[j]);
+        }
+    }
+    return status;
+}
+
+static const struct { const char *name; int sig; } signames[] = {
+    {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL},
+    {"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"TERM", SIGTERM}, {"CONT", SIGCONT},
+    {"STOP", SIGSTOP}, {"TSTP", SIGTSTP},
+};
+
+// "9", "KILL" or "SIGKILL", -1 if it's none of them
+static int parse_signal(const char *s) {
+    char *end;
+    long n = strtol(s, &end, 10);
+    if (*s && *end == '\0') return (n > 0 && n < NSIG) ? (int)n : -1;
+    if (strncmp(s, "SIG", 3) == 0) s += 3;
+    for (size_t i = 0; i < sizeof(signames) / sizeof(signames[0]); i++) {
+        if (strcmp(s, signames[i].name) == 0) return signames[i].sig;
+    }
+    return -1;
+}
+
+// kill [-s SIG | -SIG] %N|pid...
+// jobs get the signal as a whole process group; kill -9 on a job in a cgroup
+// uses cgroup.kill so nothing that escaped the group survives
+int builtin_kill(char **argv) {
+    int sig = SIGTERM, i = 1;
+    if (argv[i] && strcmp(argv[i], "-s") == 0) {
+        if (!argv[i + 1] || (sig = parse_signal(argv[i + 1])) < 0) {
+            fprintf(stderr, "kill: %s: bad signal\n", argv[i + 1] ? argv[i + 1] : "");
+            return 2;
+        }
+        i += 2;
+    } else if (argv[i] && argv[i][0] == '-' && argv[i][1]) {
+        if ((sig = parse_signal(argv[i] + 1)) < 0) {
+            fprintf(stderr, "kill: %s: bad signal\n", argv[i] + 1);
+            return 2;
+        }
+        i++;
+    }
+    if (!argv[i]) {
+        fprintf(stderr, "kill: usage: kill [-s SIG | -SIG] %%N|pid...\n");
+        return 2;
+    }
+
+    int status = 0;
+    for (; argv[i]; i++) {
+        int rc;
+        if (argv[i][0] == '%') {
+            int slot = jobs_find(argv[i]);
+            rc = slot < 0 ? -1 : jobs_signal(slot, sig);
+        } else {
+            char *end;
+            long pid = strtol(argv[i], &end, 10);
+            rc = (*end || pid == 0) ? -1 : kill((pid_t)pid, sig);
+        }
+        if (rc < 0) {
+            fprintf(stderr, "kill: %s: no such job or process\n", argv[i]);
+            status = 1;
+        }
+    }
+    jobs_poll(); // a killed job may free room for queued ones
+    return status;
+}
+
+// set -o [name=value ...], no options lists the current settings
+//   maxjobs=N      background jobs allowed to run at once, the rest are queued
+//   maxload=F      hold queued jobs while the 1-minute load average is above F
+//   maxpressure=P  ... or while PSI cpu "some avg10" is above P percent
+//   jobprio=N      priority of jobs queued after this, higher starts first
+//   cachesize=MB   size cap on the cache builtin's store (cache.h)
+//   pin=off|on|verbose   put pipeline stages on CPUs sharing a cache (topo.h)
+//   cgroups=on|off, cpu.max=, memory.max=, io.max=   per-job cgroups, see cgroup.h
+static const char *const pin_modes[] = { "off", "on", "verbose" };
+
+int builtin_set(char **argv) {
+    if (!argv[1] || strcmp(argv[1], "-o") != 0) {
+        fprintf(stderr, "set: usage: set -o [name=value ...]\n");
+        return 2;
+    }
+    if (!argv[2]) {
+        printf("maxjobs=%d\n", jobs_get_max_running());
+        printf("maxload=%g\n", jobs_get_max_load());
+        printf("maxpressure=%g\n", jobs_get_max_pressure());
+        printf("jobprio=%d\n", jobs_get_queue_priority());
+        printf("cachesize=%ld\n", cache_get_max_size() >> 20);
+        printf("pin=%s\n", pin_modes[topo_get_mode()]);
+        cgroup_print_options();
+        return 0;
+    }
+    int status = 0;
+    for (int i = 2; argv[i]; i++) {
+        char *eq = strchr(argv[i], '=');
+        char *end = NULL;
+        if (!eq || eq[1] == '\0') {
+            fprintf(stderr, "set: %s: expected name=value\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        size_t len = (size_t)(eq - argv[i]);
+        if (len == 7 && strncmp(argv[i], "maxjobs", len) == 0) {
+            long v = strtol(eq + 1, &end, 10);
+            if (*end == '\0' && v > 0) {
+                jobs_set_max_running((int)v);
+                continue;
+            }
+        } else if (len == 7 && strncmp(argv[i], "maxload", len) == 0) {
+            double v = strtod(eq + 1, &end);
+            if (*end == '\0' && v >= 0) {
+                jobs_set_max_load(v);
+                continue;
+            }
+        } else if (len == 11 && strncmp(argv[i], "maxpressure", len) == 0) {
+            double v = strtod(eq + 1, &end);
+            if (*end == '\0' && v >= 0) {
+                jobs_set_max_pressure(v);
+                continue;
+            }
+        } else if (len == 7 && strncmp(argv[i], "jobprio", len) == 0) {
+            long v = strtol(eq + 1, &end, 10);
+            if (*end == '\0') {
+                jobs_set_queue_priority((int)v);
+                continue;
+            }
+        } else if (len == 9 && strncmp(argv[i], "cachesize", len) == 0) {
+            long v = strtol(eq + 1, &end, 10);
+            if (*end == '\0' && v >= 0) {
+                cache_set_max_size(v << 20);
+                continue;
+            }
+        } else if (len == 3 && strncmp(argv[i], "pin", len) == 0) {
+            int m = 0;
+            while (m <= PIN_VERBOSE && strcmp(eq + 1, pin_modes[m]) != 0) m++;
+            if (m <= PIN_VERBOSE) {
+                topo_set_mode((pin_mode_t)m);
+                continue;
+            }
+        } else {
+            *eq = '\0';
+            int rc = cgroup_set_option(argv[i], eq + 1);
+            *eq = '=';
+            if (rc == 0) {
+                fprintf(stderr, "set: %.*s: unknown option\n", (int)len, argv[i]);
+            }
+            if (rc <= 0) status = 1; // cgroup.c explains its own failures
+            continue;
+        }
+        fprintf(stderr, "set: %s: bad value\n", argv[i]);
+        status = 1;
+    }
+    jobs_poll(); // a raised limit may let queued jobs start now
+    return status;
+}
+
+// runs a builtin in the shell process, with its redirections undone afterwards
+static int run_builtin(const struct builtin *b, struct command *cmd) {
+    struct redir_saved saved = {0};
+    int status;
+    if (redir_apply(cmd->redirs, cmd->nredirs, &saved) < 0) {
+        status = 1;
+    } else {
+        status = builtin_run(b, cmd->argv);
+    }
+    redir_restore(&saved);
+    clearerr(stdout);
+    return status;
+}
+
+// a word of the form NAME=value
+static int is_assignment(const char *word) {
+    const char *eq = strchr(word, '=');
+    return eq && vars_valid_name(word, eq - word);
+}
+
+// "A=1 B=2" on its own sets shell variables (kept exported if they were)
+static int run_assignments(char **argv) {
+    for (int i = 0; argv[i]; i++) {
+        char *eq = strchr(argv[i], '=');
+        *eq = '\0';
+        int rc = vars_set(argv[i], eq + 1, 0);
+        *eq = '=';
+        if (rc < 0) return 1;
+    }
+    return 0;
+}
+
+// runs one simple command, builtins in-process and everything else via exec.c
+static int eval_command(struct command *cmd, const char *text) {
+    const struct builtin *b;
+
+    if (!cmd->has_pipe && (!cmd->argv || !cmd->argv[0])) {
+        return 0; // every word expanded to nothing
+    }
+
+    if (cmd->has_pipe) {
+        if (!run_single_pipeline(cmd)) return 1;
+        return exec_last_status();
+    } else if ((b = builtin_find(cmd->argv[0])) != NULL && !(b->flags & BUILTIN_NOEXEC) &&
+               !(cmd->background && builtin_forkable(b))) {
+        int status = run_builtin(b, cmd);
+        if (status == 128 + SIGINT) {
+            interrupted = 1; // e.g. bench whose run got ctrl-c
+        }
+        return status;
+    } else if (is_assignment(cmd->argv[0])) {
+        for (int i = 1; cmd->argv[i]; i++) {
+            if (!is_assignment(cmd->argv[i])) return 127; // no per-command environments
+        }
+        return run_assignments(cmd->argv);
+    } else if (cmd->background) {
+        if (!run_single_background(cmd, text)) return 1;
+        return 0;
+    }
+
+    if (!run_simple_foreground(cmd, text)) return 1;
+    int status = exec_last_status();
+    if (status == 128 + SIGINT) {
+        interrupted = 1; // ctrl-c on a child also stops the loop around it
+    }
+    return status;
+}
+
+// a loop stops on break, on ctrl-c, or when a continue targets an outer loop
+static int loop_should_stop(void) {
+    if (interrupted) return 1;
+    if (break_levels > 0) {
+        break_levels--;
+        return 1;
+    }
+    if (continue_levels > 1) {
+        continue_levels--;
+        return 1;
+    }
+    continue_levels = 0;
+    return 0;
+}
+
+static int eval_list(struct node *n) {
+    for (; n && !interrupted && !break_levels && !continue_levels; n = n->next) {
+        switch (n->type) {
+        case NODE_CMD: {
+            jobs_poll(); // let queued jobs start as earlier ones finish
+            // words are expanded on every run, the parse itself is reused
+            struct command cmd;
+            if (!expand_command(&n->cmd, &cmd)) {
+                last_status = 1;
+                break;
+            }
+            last_status = eval_command(&cmd, n->text);
+            free_command(&cmd);
+            break;
+        }
+        case NODE_IF:
+            if (eval_list(n->cond) == 0) {
+                eval_list(n->body);
+            } else if (n->alt) {
+                eval_list(n->alt);
+            } else {
+                last_status = 0;
+            }
+            break;
+        case NODE_WHILE: {
+            int status = 0;
+            loop_depth++;
+            while (eval_list(n->cond) == 0 && !interrupted) {
+                status = eval_list(n->body);
+                if (loop_should_stop()) break;
+            }
+            loop_depth--;
+            last_status = status;
+            break;
+        }
+        case NODE_FOR: {
+            int status = 0;
+            loop_depth++;
+            char **words;
+            if (!expand_words(n->words, &words)) {
+                loop_depth--;
+                last_status = 1;
+                break;
+            }
+            pathexp_cache_clear();
+            for (int i = 0; words[i] != NULL; i++) {
+                vars_set(n->var, words[i], 0);
+                status = eval_list(n->body);
+                if (loop_should_stop()) break;
+            }
+            for (int i = 0; words[i] != NULL; i++) free(words[i]);
+            free(words);
+            loop_depth--;
+            last_status = status;
+            break;
+        }
+        }
+        // $? for the next command, whether this was a simple one or a compound one
+        vars_set_last_status(last_status);
+    }
+    return last_status;
+}
+
+int eval_nested(struct node *script) {
+    return eval_list(script);
+}
+
+int eval_script(struct node *script) {
+    // ctrl-c is ignored at the prompt, but while we evaluate it must be able
+    // to stop loops that never leave the shell process
+    struct sigaction sa, old;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigint;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &sa, &old);
+
+    interrupted = 0;
+    break_levels = continue_levels = 0;
+    int status = eval_list(script);
+    vars_set_last_status(status);
+
+    sigaction(SIGINT, &old, NULL);
+    return status;
+}
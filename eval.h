@@ -0,0 +1,22 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "parser.h"
+
+// runs a parsed script in the shell process and returns the last exit status
+// loops and conditionals are evaluated here, only external commands fork
+int eval_script(struct node *script);
+
+// the same from inside a running evaluation (an in-shell $(...)): keeps the
+// outer one's ctrl-c handler, and a ctrl-c already seen or a pending
+// break/continue stays in effect
+int eval_nested(struct node *script);
+
+// exit status of the last command that ran
+int eval_last_status(void);
+
+// 1 once ctrl-c reached the shell (or a child) during the current evaluation,
+// so long-running builtins can stop early
+int eval_interrupted(void);
+
+#endif /* EVAL_H */
@@ -0,0 +1,188 @@
+// jsonget: prints one top-level field of a JSON object, as a loadable builtin
+// usage: jsonget key [file]   (reads stdin without a file)
+// strings are printed unescaped, anything else (numbers, objects, ...) as written
+// exits 0 if the key was found, 1 if not, 2 on bad input
+//
+//   make examples
+//   enable -f ./examples/jsonget.so jsonget
+//   jsonget name < package.json
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "yash_builtin.h"
+
+struct input {
+    const char *p;
+    const char *end;
+};
+
+static void skip_ws(struct input *in) {
+    while (in->p < in->end && (*in->p == ' ' || *in->p == '\t' || *in->p == '\n' || *in->p == '\r')) {
+        in->p++;
+    }
+}
+
+// moves past a string starting at the opening quote, 0 if it isn't closed
+static int skip_string(struct input *in) {
+    for (in->p++; in->p < in->end; in->p++) {
+        if (*in->p == '\\') {
+            in->p++;
+        } else if (*in->p == '"') {
+            in->p++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// moves past any value; objects and arrays by bracket depth
+static int skip_value(struct input *in) {
+    skip_ws(in);
+    if (in->p >= in->end) return 0;
+    if (*in->p == '"') return skip_string(in);
+    if (*in->p == '{' || *in->p == '[') {
+        int depth = 0;
+        while (in->p < in->end) {
+            char c = *in->p;
+            if (c == '"') {
+                if (!skip_string(in)) return 0;
+                continue;
+            }
+            if (c == '{' || c == '[') depth++;
+            if (c == '}' || c == ']') depth--;
+            in->p++;
+            if (depth == 0) return 1;
+        }
+        return 0;
+    }
+    // number, true, false, null
+    const char *start = in->p;
+    while (in->p < in->end && !strchr(",}] \t\r\n", *in->p)) in->p++;
+    return in->p > start;
+}
+
+static void put_utf8(unsigned cp) {
+    if (cp < 0x80) {
+        putchar(cp);
+    } else if (cp < 0x800) {
+        putchar(0xc0 | (cp >> 6));
+        putchar(0x80 | (cp & 0x3f));
+    } else {
+        putchar(0xe0 | (cp >> 12));
+        putchar(0x80 | ((cp >> 6) & 0x3f));
+        putchar(0x80 | (cp & 0x3f));
+    }
+}
+
+// prints the string between s and end (quotes excluded) with escapes undone
+static void print_string(const char *s, const char *end) {
+    for (; s < end; s++) {
+        if (*s != '\\' || s + 1 >= end) {
+            putchar(*s);
+            continue;
+        }
+        s++;
+        switch (*s) {
+        case 'n': putchar('\n'); break;
+        case 't': putchar('\t'); break;
+        case 'r': putchar('\r'); break;
+        case 'b': putchar('\b'); break;
+        case 'f': putchar('\f'); break;
+        case 'u':
+            if (end - s > 4) {
+                char hex[5] = { s[1], s[2], s[3], s[4], '\0' };
+                put_utf8((unsigned)strtoul(hex, NULL, 16));
+                s += 4;
+            }
+            break;
+        default: putchar(*s); break; // \" \\ \/
+        }
+    }
+}
+
+static int find_field(const char *buf, size_t len, const char *key) {
+    struct input in = { buf, buf + len };
+    size_t keylen = strlen(key);
+
+    skip_ws(&in);
+    if (in.p >= in.end || *in.p != '{') return 2;
+    in.p++;
+    while (1) {
+        skip_ws(&in);
+        if (in.p < in.end && *in.p == '}') return 1;
+        if (in.p >= in.end || *in.p != '"') return 2;
+        const char *name = in.p + 1;
+        if (!skip_string(&in)) return 2;
+        size_t namelen = (size_t)(in.p - 1 - name);
+
+        skip_ws(&in);
+        if (in.p >= in.end || *in.p != ':') return 2;
+        in.p++;
+        skip_ws(&in);
+        const char *value = in.p;
+        if (!skip_value(&in)) return 2;
+
+        // keys are compared as written, escapes in key names aren't decoded
+        if (namelen == keylen && memcmp(name, key, keylen) == 0) {
+            if (*value == '"') {
+                print_string(value + 1, in.p - 1);
+            } else {
+                fwrite(value, 1, (size_t)(in.p - value), stdout);
+            }
+            putchar('\n');
+            return 0;
+        }
+
+        skip_ws(&in);
+        if (in.p < in.end && *in.p == ',') {
+            in.p++;
+        } else if (in.p < in.end && *in.p == '}') {
+            return 1;
+        } else {
+            return 2;
+        }
+    }
+}
+
+static int jsonget(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: jsonget key [file]\n");
+        return 2;
+    }
+    FILE *f = stdin;
+    if (argc == 3 && !(f = fopen(argv[2], "r"))) {
+        perror(argv[2]);
+        return 2;
+    }
+
+    size_t len = 0, cap = 4096;
+    char *buf = malloc(cap);
+    size_t n;
+    while (buf && (n = fread(buf + len, 1, cap - len, f)) > 0) {
+        len += n;
+        if (len == cap) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) {
+                free(buf);
+                buf = NULL;
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+    }
+    // the shell's stdin is shared with us, so leave it usable for the next command
+    if (f == stdin) {
+        clearerr(stdin);
+    } else {
+        fclose(f);
+    }
+    if (!buf) return 2;
+
+    int rc = find_field(buf, len, argv[1]);
+    if (rc == 2) fprintf(stderr, "jsonget: not a JSON object\n");
+    free(buf);
+    return rc;
+}
+
+YASH_BUILTIN(jsonget) = { YASH_BUILTIN_ABI, "jsonget", jsonget, "jsonget key [file]", NULL, NULL };
@@ -1,5 +1,11 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include "exec.h"
+#include "redir.h"
+#include "zygote.h"
+#include "vars.h"
+#include "cgroup.h"
+#include "builtins.h"
 #include <unistd.h>
 #include <sys/wait.h>
 #include <sys/types.h>
@@ -8,14 +14,38 @@
 #include <termios.h>
 #include "jobs.h"
 #include <errno.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <sched.h>
+#include "topo.h"
+#include <stdlib.h>
 
 
+extern char **environ;
+
 static pid_t SHELL_PGID = -1;
 void exec_set_shell_pgid(pid_t pgid){
     SHELL_PGID = pgid;
     return;
 }
 
+static int last_status = 0;
+int exec_last_status(void){
+    return last_status;
+}
+
+// turn a waitpid() status into a shell exit status (128+sig for signals)
+static void record_status(int status){
+    if (WIFEXITED(status)) {
+        last_status = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        last_status = 128 + WTERMSIG(status);
+    } else if (WIFSTOPPED(status)) {
+        last_status = 128 + WSTOPSIG(status);
+    }
+}
+
 int exec_foreground_job(pid_t pgid, int job_slot, job_state_t st, const char *cmdline) {
     if(cmdline){
         printf("%s\n", cmdline);
@@ -42,6 +72,7 @@ int exec_foreground_job(pid_t pgid, int job_slot, job_state_t st, const char *cm
             break;
         }
         if (WIFSTOPPED(status) || WIFEXITED(status) || WIFSIGNALED(status)){
+            record_status(status);
             break;
         }
     }
@@ -58,65 +89,117 @@ int exec_foreground_job(pid_t pgid, int job_slot, job_state_t st, const char *cm
 }
 
 
-int run_simple_foreground(struct command *cmd, const char *cmdline) {
-    if (!cmd->argv || !cmd->argv[0] || cmd->has_pipe || cmd->background) {
-        putchar('\n');
-        return 0;
+void exec_close_cloexec_fds(void) {
+    DIR *d = opendir("/proc/self/fd");
+    if (!d) return;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        int fd = atoi(e->d_name);
+        if (fd <= STDERR_FILENO || fd == dirfd(d)) continue;
+        int flags = fcntl(fd, F_GETFD);
+        if (flags >= 0 && (flags & FD_CLOEXEC)) close(fd);
     }
+    closedir(d);
+}
 
-    pid_t pid = fork();
-    if(pid < 0){
-        //For some reason if the fork fails, we will just return 0
-        putchar('\n');
-        return 0;
+void exec_child(char **argv, char **envp, const struct redir *redirs, int nredirs, pid_t pgid, int foreground, int in_fd, int out_fd, int err_fd, int cpu) {
+    setpgid(0, pgid);
+    if (cpu >= 0) {
+        // before exec, so the program never runs anywhere else (best effort)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+    if (foreground) {
+        // take the terminal ourselves too, the parent's tcsetpgrp may come after we
+        // already started reading it (SIGTTOU is ignored, so this is allowed)
+        tcsetpgrp(STDIN_FILENO, getpgrp());
     }
 
-    if(pid == 0){
-        //This if branch is for the child process (pid == 0)
-        setpgid(0, 0); //put child in its own process group
+    signal(SIGINT, SIG_DFL); //reset so crtl c/z exits the child process
+    signal(SIGTSTP, SIG_DFL);
 
-        signal(SIGINT, SIG_DFL); //reset so crtl c/z exits the child process
-        signal(SIGTSTP, SIG_DFL);
+    // pipe ends go first so a file redirection on the same side wins
+    if (in_fd >= 0 && in_fd != STDIN_FILENO && dup3(in_fd, STDIN_FILENO, 0) < 0) _exit(1);
+    if (out_fd >= 0 && out_fd != STDOUT_FILENO && dup3(out_fd, STDOUT_FILENO, 0) < 0) _exit(1);
+    if (err_fd >= 0 && err_fd != STDERR_FILENO && dup3(err_fd, STDERR_FILENO, 0) < 0) _exit(1);
+    if (redir_apply(redirs, nredirs, NULL) < 0) {
+        _exit(1); //if a file is missing, we exit
+    }
 
-        if(cmd->infile != NULL){
-            int fd = open(cmd->infile,O_RDONLY);
-            if(fd < 0){
-                _exit(0); //if the file is missing, we exit
-            }
-            if(dup2(fd, STDIN_FILENO) < 0){
-                _exit(0);
-            }
-            close(fd);
-        }
+    // execvp searches the PATH of environ, so swap in the shell's exported
+    // variables first and PATH changes made with export take effect
+    if (envp) {
+        environ = envp;
+    }
 
-        if(cmd->outfile != NULL){
-            int fd = open(cmd->outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644); // 0644 same as S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH
+    // cat/tee/cp move the data themselves and the pure builtins need no
+    // program, an exec would only add its cost; a loaded builtin has none at all
+    const struct builtin *b = builtin_find(argv[0]);
+    if (b && builtin_forkable(b)) {
+        exec_close_cloexec_fds(); // our copies of the pipe ends would keep a reader from EOF
+        signal(SIGPIPE, SIG_DFL); // "cat big | head" ends the way the real cat would
+        int status = builtin_run(b, argv);
+        fflush(stdout); // _exit skips stdio
+        fflush(stderr);
+        _exit(status & 0xff);
+    }
+    execvp(argv[0], argv);
 
-            if(fd < 0){
-                _exit(0); //if the file is missing, we exit
-            }
-            if(dup2(fd, STDOUT_FILENO) < 0){
-                _exit(0);
-            }
-            close(fd);
-        }
+    //if we reach here then excevp has failed and we exit the child process
+    _exit(127);
+}
 
-        if(cmd->errfile != NULL){
-            int fd = open(cmd->errfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+static int names_coproc(const struct redir *redirs, int nredirs) {
+    for (int i = 0; i < nredirs; i++) {
+        if (redirs[i].kind == REDIR_COPROC) return 1;
+    }
+    return 0;
+}
 
-            if(fd < 0){
-                _exit(0); //if the file is missing, we exit
-            }
-            if(dup2(fd, STDERR_FILENO) < 0){
-                _exit(0);
-            }
-            close(fd);
+// starts one process of a job, through the launcher helper when it runs
+// (falling back to fork if it refuses) and with a plain fork otherwise
+// cgfd >= 0 starts it inside that job cgroup
+static pid_t spawn(char **argv, const struct redir *redirs, int nredirs, pid_t pgid, int foreground, int in_fd, int out_fd, int err_fd, int cpu, int cgfd) {
+    char **envp = vars_envp(); // cached, only rebuilt after an export changes
+
+    // a coprocess's pipes are the shell's, the helper has nothing to hand over;
+    // a builtin loaded since the helper forked is missing from its copy
+    const struct builtin *b = builtin_find(argv[0]);
+    if (zygote_active() && !names_coproc(redirs, nredirs) && !(b && b->ext)) {
+        struct zygote_req req = { argv, envp, redirs, nredirs, pgid, foreground, in_fd, out_fd, err_fd, cpu, cgfd };
+        pid_t pid = zygote_spawn(&req);
+        if (pid > 0) {
+            return pid;
         }
+    }
 
-        execvp(cmd->argv[0], cmd->argv);
+    pid_t pid = cgfd >= 0 ? cgroup_clone(cgfd, 0) : fork();
+    if (pid == 0) {
+        exec_child(argv, envp, redirs, nredirs, pgid, foreground, in_fd, out_fd, err_fd, cpu);
+    }
+    return pid;
+}
 
-        //if we reach here then excevp has failed and we exit the child process
-        _exit(0);
+int run_simple_foreground(struct command *cmd, const char *cmdline) {
+    if (!cmd->argv || !cmd->argv[0] || cmd->has_pipe || cmd->background) {
+        putchar('\n');
+        return 0;
+    }
+
+    // with cgroups on the job gets its own cgroup (cg < 0 when off)
+    int cgfd;
+    int cg = cgroup_job_create(&cgfd);
+
+    //the child goes in its own process group (pgid 0)
+    pid_t pid = spawn(cmd->argv, cmd->redirs, cmd->nredirs, 0, 1, -1, -1, -1, -1, cgfd);
+    if (cgfd >= 0) close(cgfd);
+    if(pid < 0){
+        cgroup_job_destroy(cg);
+        //For some reason if the fork fails, we will just return 0
+        putchar('\n');
+        return 0;
     }
 
     //Parent side (implied pid > 0):
@@ -130,13 +213,22 @@ int run_simple_foreground(struct command *cmd, const char *cmdline) {
     // Else pid > 0, we are in the parent process:
     int status;
     if (waitpid(pid, &status, WUNTRACED) == -1) {
+        cgroup_job_destroy(cg);
         return 1; 
     }
+    record_status(status);
 
     if (WIFSTOPPED(status)) {
         // record this stopped fg command as a job
         pid_t pids[1] = { pid };
-        jobs_add(pid, pids, 1, cmdline, STOPPED);
+        int jid = jobs_add(pid, pids, 1, cmdline, STOPPED);
+        if (jid >= 0) {
+            jobs_attach_cgroup(jid, cg);
+        } else {
+            cgroup_job_destroy(cg);
+        }
+    } else {
+        cgroup_job_destroy(cg);
     }
 
     tcsetpgrp(STDIN_FILENO, SHELL_PGID);
@@ -157,107 +249,58 @@ int run_single_pipeline(struct command *cmd) {
     }
 
     int fd[2];
-    if(pipe(fd) < 0){
+    if(pipe2(fd, O_CLOEXEC) < 0){
         //if pipe somehow return error we exit
         putchar('\n');
         return 0;
     }
     
     //Left side of pipe:
-    pid_t left = fork();
+    //left side writes into the pipe unless it redirects stdout itself
+    // both sides share one job cgroup
+    int cgfd;
+    int cg = cgroup_job_create(&cgfd);
+
+    // with "set -o pin=on" the two sides go on CPUs that share a cache, unless
+    // one of them would hand its CPU down to programs of its own
+    int cpus[2] = { -1, -1 };
+    int leaves = topo_leaf(cmd->argv[0]) && topo_leaf(cmd->pipe_argv[0]);
+    if (!leaves && topo_get_mode() == PIN_VERBOSE) {
+        fprintf(stderr, "pin: not pinning %s | %s, a stage starts other programs\n", cmd->argv[0],
+                cmd->pipe_argv[0]);
+    } else if (leaves && topo_place_pair(cpus) && topo_get_mode() == PIN_VERBOSE) {
+        fprintf(stderr, "pin: %s on cpu %d, %s on cpu %d (%s, node %d)\n", cmd->argv[0], cpus[0],
+                cmd->pipe_argv[0], cpus[1], topo_relation_name(topo_relation(cpus[0], cpus[1])),
+                topo_node(cpus[0]));
+    }
+
+    pid_t left = spawn(cmd->argv, cmd->redirs, cmd->nredirs, 0, 1, -1, fd[1], -1, cpus[0], cgfd);
     if (left < 0) {
         //if fork fails we exit
         close(fd[0]); 
         close(fd[1]);
+        if (cgfd >= 0) close(cgfd);
+        cgroup_job_destroy(cg);
         putchar('\n');
         return 0;
     }
 
-    if (left == 0) {
-        // signals switch to default
-        setpgid(0,0);
-        signal(SIGINT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
-
-        //If left side in file exists, do this part like normal
-        if (cmd->infile) {
-            int fdin = open(cmd->infile, O_RDONLY);
-            if (fdin < 0) _exit(0);
-            if (dup2(fdin, STDIN_FILENO) < 0) _exit(0);
-            close(fdin);
-        }
-
-        if (cmd->outfile) {
-            int fdout = open(cmd->outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fdout < 0) _exit(0);
-            if (dup2(fdout, STDOUT_FILENO) < 0) _exit(0);
-            close(fdout);
-        } else {
-            if (dup2(fd[1], STDOUT_FILENO) < 0) _exit(0);
-        }
-
-        if (cmd->errfile) {
-            int fde = open(cmd->errfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fde < 0) _exit(0);
-            if (dup2(fde, STDERR_FILENO) < 0) _exit(0);
-            close(fde);
-        }
-
-        close(fd[0]);
-        close(fd[1]);
-
-        execvp(cmd->argv[0], cmd->argv);
-        _exit(0);
-    }
-
     //Right side of pipe:
-    pid_t right = fork();
+    //On the right side (input side), the file takes  priority over pipe
+    pid_t right = spawn(cmd->pipe_argv, cmd->pipe_redirs, cmd->pipe_nredirs, left, 1, fd[0], -1, -1, cpus[1], cgfd);
+    if (cgfd >= 0) close(cgfd);
     if (right < 0) {
         // if second fork fails, close fds, wait for left, and exit
         close(fd[0]); 
         close(fd[1]);
         int st; 
         waitpid(left, &st, 0);
+        cgroup_job_destroy(cg);
         putchar('\n');
         return 0;
     }
 
-    if (right == 0) {
-        setpgid(0, left);
-        signal(SIGINT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
-        
-        //On the right side (input side), the file takes  priority over pipe
-        if (cmd->pipe_infile) {
-            int fdin = open(cmd->pipe_infile, O_RDONLY);
-            if (fdin < 0) _exit(0);
-            if (dup2(fdin, STDIN_FILENO) < 0) _exit(0);
-            close(fdin);
-        } else {
-            if (dup2(fd[0], STDIN_FILENO) < 0) _exit(0);
-        }
-
-        if (cmd->pipe_outfile) {
-            int fdout = open(cmd->pipe_outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fdout < 0) _exit(0);
-            if (dup2(fdout, STDOUT_FILENO) < 0) _exit(0);
-            close(fdout);
-        }
 
-        if (cmd->pipe_errfile) {
-            int fde = open(cmd->pipe_errfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fde < 0) _exit(0);
-            if (dup2(fde, STDERR_FILENO) < 0) _exit(0);
-            close(fde);
-        }
-
-        close(fd[0]);
-        close(fd[1]);
-
-        execvp(cmd->pipe_argv[0], cmd->pipe_argv);
-        _exit(0);
-    }
-    
     close(fd[0]);
     close(fd[1]);
 
@@ -272,13 +315,33 @@ int run_single_pipeline(struct command *cmd) {
     int statusLeft, statusRight;
     waitpid(left,  &statusLeft,  WUNTRACED);
     waitpid(right, &statusRight, WUNTRACED);
+    record_status(statusRight); // pipeline status is the right side's
 
     // restore shell control
     tcsetpgrp(STDIN_FILENO, SHELL_PGID);
+    cgroup_job_destroy(cg); // busy (so kept) if a side is only stopped
 
     return 1;
 }
 
+pid_t exec_launch_background(struct command *cmd, int *cg_out) {
+    return exec_start_background(cmd->argv, cmd->redirs, cmd->nredirs, -1, -1, cg_out);
+}
+
+pid_t exec_start_background(char **argv, const struct redir *redirs, int nredirs, int in_fd, int out_fd, int *cg_out) {
+    int cgfd;
+    int cg = cgroup_job_create(&cgfd);
+    pid_t pid = spawn(argv, redirs, nredirs, 0, 0, in_fd, out_fd, -1, -1, cgfd);
+    if (cgfd >= 0) close(cgfd);
+    if (pid < 0) {
+        cgroup_job_destroy(cg);
+        return -1;
+    }
+    setpgid(pid, pid); // race safety line
+    *cg_out = cg;
+    return pid;
+}
+
 int run_single_background(struct command *cmd, const char *cmdline){
     //only single commands that aren't apart of a pip can be backgrounded
     if(!cmd->argv || !cmd->argv[0] || cmd->has_pipe){
@@ -286,67 +349,23 @@ int run_single_background(struct command *cmd, const char *cmdline){
         return 0;
     }
 
-    if (!jobs_has_capacity()) { 
-        putchar('\n'); 
-        return 0; 
+    // over the limit (or others already waiting): park it, it starts as jobs finish
+    if (!jobs_admit()) {
+        if (jobs_queue(cmd, cmdline) < 0) {
+            putchar('\n'); // table is full even for queued jobs
+            return 0;
+        }
+        last_status = 0;
+        return 1;
     }
 
-    pid_t pid = fork();
+    int cg;
+    pid_t pid = exec_launch_background(cmd, &cg);
     if(pid<0) {
         putchar('\n');
         return 0;
     }
 
-    if(pid == 0){
-        //child process
-        setpgid(0, 0);
-
-        signal(SIGINT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
-
-        if(cmd->infile != NULL){
-            int fd = open(cmd->infile,O_RDONLY);
-            if(fd < 0){
-                _exit(0); //if the file is missing, we exit
-            }
-            if(dup2(fd, STDIN_FILENO) < 0){
-                _exit(0);
-            }
-            close(fd);
-        }
-
-        if(cmd->outfile != NULL){
-            int fd = open(cmd->outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644); // 0644 same as S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH
-
-            if(fd < 0){
-                _exit(0); //if the file is missing, we exit
-            }
-            if(dup2(fd, STDOUT_FILENO) < 0){
-                _exit(0);
-            }
-            close(fd);
-        }
-
-        if(cmd->errfile != NULL){
-            int fd = open(cmd->errfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-
-            if(fd < 0){
-                _exit(0); //if the file is missing, we exit
-            }
-            if(dup2(fd, STDERR_FILENO) < 0){
-                _exit(0);
-            }
-            close(fd);
-        }
-
-        execvp(cmd->argv[0], cmd->argv);
-        //if we reach here then excevp has failed and we exit the child process
-        _exit(0);
-    }
-
-    //parent (pid > 0)
-    setpgid(pid, pid); // race safety line
-
     // we don't want to give terminal control to this process since its background
     // we don't want to wait either, we want to add jobs to the table as RUNNING (in background)
     pid_t pids[1] = { pid };
@@ -355,9 +374,61 @@ int run_single_background(struct command *cmd, const char *cmdline){
     if (jid < 0) {
         kill(-pid, SIGTERM);
         waitpid(pid, NULL, 0);
+        cgroup_job_destroy(cg);
         putchar('\n');
         return 0;
     }
+    jobs_attach_cgroup(jid, cg);
 
+    last_status = 0;
     return 1;
-}
\ No newline at end of file
+}
+
+pid_t exec_start_foreground(char **argv, const struct redir *redirs, int nredirs, int out_fd, int err_fd) {
+    pid_t pid = spawn(argv, redirs, nredirs, 0, 1, -1, out_fd, err_fd, -1, -1);
+    if (pid < 0) return -1;
+    setpgid(pid, pid);
+    tcsetpgrp(STDIN_FILENO, pid);
+    return pid;
+}
+
+int exec_wait_foreground(pid_t pid, struct rusage *ru) {
+    int status, stopped = 0;
+    while (1) {
+        pid_t w = wait4(pid, &status, WUNTRACED, ru);
+        if (w == -1 && errno == EINTR) continue;
+        if (w == -1) {
+            tcsetpgrp(STDIN_FILENO, SHELL_PGID);
+            return -1;
+        }
+        if (WIFSTOPPED(status)) {
+            // ctrl-z: half a run is useless, so end it instead of making a job
+            kill(-pid, SIGKILL);
+            kill(-pid, SIGCONT);
+            stopped = 1;
+            continue;
+        }
+        break;
+    }
+    tcsetpgrp(STDIN_FILENO, SHELL_PGID);
+
+    record_status(status);
+    if (stopped && WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL) {
+        last_status = 128 + SIGTSTP; // report what the user did, not our kill
+    }
+    return last_status;
+}
+
+int exec_run_timed(char **argv, int quiet, double *wall_ms, struct rusage *ru) {
+    struct redir devnull = { STDOUT_FILENO, REDIR_OUT, "/dev/null", -1 };
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pid_t pid = exec_start_foreground(argv, quiet ? &devnull : NULL, quiet ? 1 : 0, -1, -1);
+    if (pid < 0) return -1;
+    int status = exec_wait_foreground(pid, ru);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    *wall_ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    return status;
+}
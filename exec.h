@@ -3,6 +3,7 @@
 
 #include "parser.h"
 #include <sys/types.h>
+#include <sys/resource.h>
 #include "jobs.h"
 
 int run_simple_foreground(struct command *cmd, const char *cmdline);
@@ -14,9 +15,48 @@ int run_single_pipeline(struct command *cmd);
 void exec_set_shell_pgid(pid_t pgid);
 
 //run a single background command (no pipes)
+// queues it instead when jobs_admit() says no
 int run_single_background(struct command *cmd, const char *cmdline);
 
+// starts cmd in the background as its own process group, returns the pid or -1
+// and its job cgroup in *cg_out (-1 without one); the launcher jobs.c uses for queued jobs
+pid_t exec_launch_background(struct command *cmd, int *cg_out);
+
+// the same for argv with stdin/stdout on in_fd/out_fd (-1 = inherited); the
+// caller adds the job (coprocesses, which can't wait in the queue)
+pid_t exec_start_background(char **argv, const struct redir *redirs, int nredirs, int in_fd, int out_fd, int *cg_out);
+
 int exec_foreground_job(pid_t pgid, int job_slot, job_state_t st, const char *cmdline);
 
+// child side of every launch: join pgid (0 = lead a new group), take the
+// terminal if foreground, restore default signals, wire up stdin/stdout/stderr
+// fds such as pipe ends (-1 = none), pin itself to cpu (-1 = anywhere)
+// and redirections, then exec argv with envp (NULL = inherited environ)
+// never returns
+void exec_child(char **argv, char **envp, const struct redir *redirs, int nredirs, pid_t pgid, int foreground, int in_fd, int out_fd, int err_fd, int cpu);
+
+// does what exec would: closes every close-on-exec fd, for a child that
+// goes on running shell code instead of a program
+void exec_close_cloexec_fds(void);
+
+// starts argv in the foreground like a simple command, in its own process
+// group with the terminal, stdout/stderr on out_fd/err_fd when >= 0
+// returns the pid, or -1 if it couldn't be started
+pid_t exec_start_foreground(char **argv, const struct redir *redirs, int nredirs, int out_fd, int err_fd);
+
+// waits for what exec_start_foreground() started and takes the terminal back;
+// ctrl-z kills it rather than stopping it, ru (if set) gets its rusage
+// returns its exit status (128+sig if killed), -1 if the wait failed
+int exec_wait_foreground(pid_t pid, struct rusage *ru);
+
+// runs argv once in the foreground like a simple command and times it: wall
+// clock from spawn to reap, and the child's user/sys time (rusage) from wait4
+// stdout goes to /dev/null when quiet; ctrl-z kills it rather than stopping it
+// returns its exit status (128+sig if killed), -1 if it couldn't be started
+int exec_run_timed(char **argv, int quiet, double *wall_ms, struct rusage *ru);
+
+// exit status of the last foreground command (128+sig if it was killed/stopped)
+int exec_last_status(void);
+
 
 #endif /* EXEC_H */
@@ -1,50 +1,78 @@
+#define _GNU_SOURCE
 #include "jobs.h"
+#include "cgroup.h"
 #include <sys/wait.h>
+#include <sys/syscall.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
 #include <unistd.h>
 #include <errno.h>
-#define MAX_JOBS 20
 
 typedef struct {
     int in_use;
     int id;
     pid_t pgid;
     pid_t pid;
-    job_state_t state;  // RUNNING/STOPPED/DONE
+    job_state_t state;  // RUNNING/STOPPED/DONE/QUEUED
     char *cmdline;      // original command ran
     int marker;
+    int pidfd;          // pollable handle on pid, -1 if the kernel has no pidfds
+    int status;         // exit status once DONE
+    int cg;             // job cgroup number (cgroup.c), -1 if none
+    struct command cmd; // QUEUED: the expanded command to start later
+    int prio;           // QUEUED: higher starts first
+    long seq;           // QUEUED: arrival order among equal priorities
 } job_t;
 
-static job_t jobs[MAX_JOBS];
+static job_t jobs[JOBS_TABLE_SIZE];
 static int next_id = 1;
 
+// admission control settings ("set -o maxjobs=N" etc.)
+static int max_running = MAX_JOBS;
+static double max_load = 0;         // 1-minute load average, 0 = ignore
+static double max_pressure = 0;     // PSI cpu "some avg10" percent, 0 = ignore
+static int queue_prio = 0;
+static long queue_seq = 0;
+static job_launcher_t launcher = NULL;
+
 void jobs_init(void) {
     memset(jobs, 0, sizeof(jobs));
     next_id = 1;
 }
 
 static int find_by_pid(pid_t pid) {
-    for (int i = 0; i < MAX_JOBS; i++) {
+    for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
         if (jobs[i].in_use && jobs[i].pid == pid) return i;
     }
     return -1;
 }
 
 
+static int free_slot(void) {
+    for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
+        if (!jobs[i].in_use) return i;
+    }
+    return -1;
+}
+
+// rotate markers: old + goes to -, slot becomes the current job
+static void make_current(int slot) {
+    for (int j = 0; j < JOBS_TABLE_SIZE; j++) {
+        if (jobs[j].in_use){
+            jobs[j].marker = 2;
+        }
+    }
+    jobs[slot].marker = 1;
+}
+
 int jobs_add(pid_t pgid, const pid_t *pids, int npids, const char *cmdline, job_state_t st) {
     (void)npids;
 
     // find a free slot
-    int idx = -1;
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (!jobs[i].in_use) { 
-            idx = i; 
-            break; 
-        }
-    }
+    int idx = free_slot();
     if (idx < 0) return -1;
 
     jobs[idx].in_use = 1;
@@ -52,36 +80,44 @@ int jobs_add(pid_t pgid, const pid_t *pids, int npids, const char *cmdline, job_
     jobs[idx].pgid = pgid;
     jobs[idx].pid = pids ? pids[0] : -1;
     jobs[idx].state = st;
+    jobs[idx].status = 0;
+    jobs[idx].cg = -1;
+    // opened now, while pid surely still names our child, so wait can poll it later
+    jobs[idx].pidfd = pids ? (int)syscall(SYS_pidfd_open, pids[0], 0) : -1;
     jobs[idx].cmdline = strdup(cmdline ? cmdline : "");
     if (!jobs[idx].cmdline) { 
+        if (jobs[idx].pidfd >= 0) close(jobs[idx].pidfd);
         jobs[idx].in_use = 0; 
         return -1; 
     }
 
-    // rotate markers: old + goes to - 
-    for (int j = 0; j < MAX_JOBS; j++) {
-        if (jobs[j].in_use){
-            jobs[j].marker = 2;
-        }
-    }
-    jobs[idx].marker = 1;
+    make_current(idx);
     return jobs[idx].id;
 }
 
-void jobs_reap_and_report(void) {
+// collects exit statuses of finished children, marking their jobs DONE
+static void reap(void) {
     int st;
     pid_t pid;
     while ((pid = waitpid(-1, &st, WNOHANG)) > 0) {
         int idx = find_by_pid(pid);
         if (idx < 0) continue; // not a tracked bg job (e.g., fg child)
         // Mark done if exited or killed by signal
-        if (WIFEXITED(st) || WIFSIGNALED(st)) {
+        if (WIFEXITED(st)) {
             jobs[idx].state = DONE;
+            jobs[idx].status = WEXITSTATUS(st);
+        } else if (WIFSIGNALED(st)) {
+            jobs[idx].state = DONE;
+            jobs[idx].status = 128 + WTERMSIG(st);
         }
     }
+}
+
+void jobs_reap_and_report(void) {
+    jobs_poll();
 
     // Print and remove DONE jobs
-    for (int i = 0; i < MAX_JOBS; i++) {
+    for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
         if (!jobs[i].in_use){
             continue;
         }
@@ -92,8 +128,32 @@ void jobs_reap_and_report(void) {
     }
 }
 
-void jobs_print(void) {
-    for (int i = 0; i < MAX_JOBS; i++) {
+// memory size the way ls -h does it
+static void print_size(long long bytes) {
+    const char *units = "BKMGT";
+    double v = (double)bytes;
+    int u = 0;
+    while (v >= 1024 && u < 4) {
+        v /= 1024;
+        u++;
+    }
+    if (u == 0) {
+        printf("%lldB", bytes);
+    } else {
+        printf("%.1f%c", v, units[u]);
+    }
+}
+
+static void print_pressure(const char *name, double v) {
+    if (v < 0) {
+        printf("  %s -", name);
+    } else {
+        printf("  %s %.2f", name, v);
+    }
+}
+
+void jobs_print(int verbose) {
+    for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
         if(!jobs[i].in_use){
             continue;
         }
@@ -103,6 +163,8 @@ void jobs_print(void) {
             st = "Running";
         } else if (jobs[i].state == STOPPED) {
             st = "Stopped";
+        } else if (jobs[i].state == QUEUED) {
+            st = "Queued";
         } else {
             st = "Done";
         }
@@ -112,13 +174,33 @@ void jobs_print(void) {
         } else{
             mark = "-";
         }
-        printf("[%d]%s  %s  %s\n", jobs[i].id, mark, st, jobs[i].cmdline);
+        if (!verbose) {
+            printf("[%d]%s  %s  %s\n", jobs[i].id, mark, st, jobs[i].cmdline);
+            continue;
+        }
+
+        // -l: pid, and the job cgroup's memory and PSI "some avg10" when it has one
+        printf("[%d]%s  %d  %s  %s\n", jobs[i].id, mark, (int)jobs[i].pid, st, jobs[i].cmdline);
+        struct cgroup_stats cs;
+        if (jobs[i].cg >= 0 && cgroup_job_stats(jobs[i].cg, &cs) == 0) {
+            printf("      memory ");
+            if (cs.memory_current < 0) {
+                printf("-");
+            } else {
+                print_size(cs.memory_current);
+            }
+            printf("  pressure:");
+            print_pressure("cpu", cs.cpu_some);
+            print_pressure("memory", cs.memory_some);
+            print_pressure("io", cs.io_some);
+            putchar('\n');
+        }
     }
     putchar('\n');
 }
 
 int jobs_get_current(pid_t *pgid_out, job_state_t *state_out, const char **cmd_out, int *slot_out) {
-    for (int i = 0; i < MAX_JOBS; i++) {
+    for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
         if (jobs[i].in_use && jobs[i].marker == 1) {
             if (pgid_out){
                 *pgid_out = jobs[i].pgid;
@@ -139,36 +221,37 @@ int jobs_get_current(pid_t *pgid_out, job_state_t *state_out, const char **cmd_o
 }
 
 void jobs_set_state(int slot, job_state_t st) {
-    if (slot >= 0 && slot < MAX_JOBS && jobs[slot].in_use) {
+    if (slot >= 0 && slot < JOBS_TABLE_SIZE && jobs[slot].in_use) {
         jobs[slot].state = st;
         // keep markers as same for now , current stays as +
     }
 }
 
 void jobs_remove(int slot) {
-    if (slot < 0 || slot >= MAX_JOBS || !jobs[slot].in_use) return;
+    if (slot < 0 || slot >= JOBS_TABLE_SIZE || !jobs[slot].in_use) return;
 
     int was_plus = (jobs[slot].marker == 1);
 
     free(jobs[slot].cmdline);
+    if (jobs[slot].state == QUEUED) free_command(&jobs[slot].cmd);
+    if (jobs[slot].pidfd >= 0) close(jobs[slot].pidfd);
+    jobs[slot].pidfd = -1;
+    cgroup_job_destroy(jobs[slot].cg);
+    jobs[slot].cg = -1;
     jobs[slot].in_use = 0;
 
     if (was_plus) {
         int best = -1;
         int best_id = -1;
-        for (int i = 0; i < MAX_JOBS; i++) {
-            if (jobs[i].in_use && jobs[i].id > best_id) {
+        for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
+            // queued jobs have no process group yet, so they can't be current
+            if (jobs[i].in_use && jobs[i].state != QUEUED && jobs[i].id > best_id) {
                 best = i; 
                 best_id = jobs[i].id;
             }
         }
         if (best != -1) {
-            for (int i = 0; i < MAX_JOBS; i++){
-                if (jobs[i].in_use){
-                    jobs[i].marker = 2;
-                }
-            }
-            jobs[best].marker = 1;
+            make_current(best);
         }
     }
 }
@@ -181,7 +264,7 @@ int jobs_get_current_stopped(pid_t *pgid_out, int *slot_out, const char **cmd_ou
     int best_id = -1;
 
     // first try the current +
-    for (int i = 0; i < MAX_JOBS; i++) {
+    for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
         if (jobs[i].in_use && jobs[i].marker == 1 && jobs[i].state == STOPPED) {
             best = i; 
             best_id = jobs[i].id;
@@ -190,7 +273,7 @@ int jobs_get_current_stopped(pid_t *pgid_out, int *slot_out, const char **cmd_ou
     }
     // if not found, pick most recent stopped by id
     if (best == -1) {
-        for (int i = 0; i < MAX_JOBS; i++) {
+        for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
             if (jobs[i].in_use && jobs[i].state == STOPPED && jobs[i].id > best_id) {
                 best = i; 
                 best_id = jobs[i].id;
@@ -219,14 +302,14 @@ int jobs_get_current_stopped(pid_t *pgid_out, int *slot_out, const char **cmd_ou
 }
 
 void jobs_mark_running(int slot) {
-    if (slot < 0 || slot >= MAX_JOBS || !jobs[slot].in_use) return;
-    for (int i = 0; i < MAX_JOBS; i++) if (jobs[i].in_use) jobs[i].marker = 2;
+    if (slot < 0 || slot >= JOBS_TABLE_SIZE || !jobs[slot].in_use) return;
+    for (int i = 0; i < JOBS_TABLE_SIZE; i++) if (jobs[i].in_use) jobs[i].marker = 2;
     jobs[slot].marker = 1;
     jobs[slot].state  = RUNNING;
 }
 
 int jobs_has_capacity(void) {
-    for (int i = 0; i < MAX_JOBS; i++){
+    for (int i = 0; i < JOBS_TABLE_SIZE; i++){
         if (!jobs[i].in_use){
             return 1;
         }
@@ -234,3 +317,292 @@ int jobs_has_capacity(void) {
     return 0;
 }
 
+
+
+int jobs_find(const char *spec) {
+    if (!spec || !*spec) return -1;
+    char *end;
+    if (spec[0] == '%') {
+        long id = strtol(spec + 1, &end, 10);
+        if (*end != '\0' || end == spec + 1) return -1;
+        for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
+            if (jobs[i].in_use && jobs[i].id == id) return i;
+        }
+        return -1;
+    }
+    long pid = strtol(spec, &end, 10);
+    if (*end != '\0' || pid <= 0) return -1;
+    return find_by_pid((pid_t)pid);
+}
+
+int jobs_running_slots(int *slots, int max) {
+    int n = 0;
+    for (int i = 0; i < JOBS_TABLE_SIZE && n < max; i++) {
+        if (jobs[i].in_use && (jobs[i].state == RUNNING || jobs[i].state == QUEUED)) slots[n++] = i;
+    }
+    return n;
+}
+
+int jobs_exit_status(int slot) {
+    if (slot < 0 || slot >= JOBS_TABLE_SIZE || !jobs[slot].in_use || jobs[slot].state != DONE) return -1;
+    return jobs[slot].status;
+}
+
+// reaps slot's process if it has exited; returns 1 once the job is DONE
+static int collect(int slot) {
+    job_t *j = &jobs[slot];
+    if (j->state == DONE) return 1;
+    if (j->state == QUEUED) return 0;
+
+    if (j->pidfd >= 0) {
+        siginfo_t si;
+        memset(&si, 0, sizeof(si));
+        if (waitid(P_PIDFD, j->pidfd, &si, WEXITED | WNOHANG) < 0) {
+            if (errno != ECHILD) return 0;
+            j->state = DONE; // someone else reaped it, status is lost
+            return 1;
+        }
+        if (si.si_pid == 0) return 0;
+        j->state = DONE;
+        j->status = si.si_code == CLD_EXITED ? si.si_status : 128 + si.si_status;
+        return 1;
+    }
+
+    int st;
+    pid_t w = waitpid(j->pid, &st, WNOHANG);
+    if (w == 0) return 0;
+    j->state = DONE;
+    if (w > 0) {
+        j->status = WIFEXITED(st) ? WEXITSTATUS(st) : 128 + WTERMSIG(st);
+    }
+    return 1;
+}
+
+int jobs_wait(const int *slots, int n, int any) {
+    struct pollfd pfds[JOBS_TABLE_SIZE];
+    int which[JOBS_TABLE_SIZE];
+
+    while (1) {
+        jobs_poll(); // start whatever queued jobs fit now
+
+        int npoll = 0, pending = 0, no_pidfd = 0, last_done = -1;
+        for (int i = 0; i < n; i++) {
+            int slot = slots[i];
+            if (slot < 0 || slot >= JOBS_TABLE_SIZE || !jobs[slot].in_use) continue;
+            if (collect(slot)) {
+                last_done = slot;
+                continue;
+            }
+            // its pidfd only wakes us when it exits, which a stopped job never does
+            if (jobs[slot].state == STOPPED) return -3;
+            pending++;
+            if (jobs[slot].state == QUEUED) {
+                no_pidfd = 1; // nothing to poll yet, re-check admission soon
+                continue;
+            }
+            if (jobs[slot].pidfd < 0) {
+                no_pidfd = 1;
+                continue;
+            }
+            pfds[npoll].fd = jobs[slot].pidfd;
+            pfds[npoll].events = POLLIN;
+            which[npoll++] = slot;
+        }
+        if (pending == 0 || (any && last_done >= 0)) {
+            return last_done;
+        }
+
+        // pidfds become readable the moment the child exits; old kernels
+        // (and queued jobs waiting on the load to drop) fall back to a short poll
+        int rc = poll(pfds, npoll, no_pidfd ? 10 : -1);
+        if (rc < 0) {
+            if (errno == EINTR) return -2; // caller decides if the signal ends the wait
+            return last_done;
+        }
+        if (any) {
+            for (int i = 0; i < npoll; i++) {
+                if (pfds[i].revents && collect(which[i])) return which[i];
+            }
+        }
+    }
+}
+
+
+/* ---------- admission control ---------- */
+
+void jobs_set_launcher(job_launcher_t fn) {
+    launcher = fn;
+}
+
+void jobs_set_max_running(int n) {
+    if (n < 1) n = 1;
+    if (n > JOBS_TABLE_SIZE) n = JOBS_TABLE_SIZE;
+    max_running = n;
+}
+
+int jobs_get_max_running(void) {
+    return max_running;
+}
+
+void jobs_set_max_load(double load) {
+    max_load = load;
+}
+
+double jobs_get_max_load(void) {
+    return max_load;
+}
+
+void jobs_set_max_pressure(double avg10) {
+    max_pressure = avg10;
+}
+
+double jobs_get_max_pressure(void) {
+    return max_pressure;
+}
+
+void jobs_set_queue_priority(int prio) {
+    queue_prio = prio;
+}
+
+int jobs_get_queue_priority(void) {
+    return queue_prio;
+}
+
+// first field of /proc/loadavg, -1 if unavailable
+static double read_loadavg(void) {
+    FILE *f = fopen("/proc/loadavg", "re");
+    if (!f) return -1;
+    double load = -1;
+    if (fscanf(f, "%lf", &load) != 1) load = -1;
+    fclose(f);
+    return load;
+}
+
+// "some avg10" of /proc/pressure/cpu, -1 if PSI is unavailable
+static double read_cpu_pressure(void) {
+    FILE *f = fopen("/proc/pressure/cpu", "re");
+    if (!f) return -1;
+    double avg10 = -1;
+    if (fscanf(f, "some avg10=%lf", &avg10) != 1) avg10 = -1;
+    fclose(f);
+    return avg10;
+}
+
+// room for one more running background job, ignoring the queue
+static int room_to_start(void) {
+    int running = 0;
+    for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
+        if (jobs[i].in_use && jobs[i].state == RUNNING) running++;
+    }
+    if (running >= max_running) return 0;
+    // with nothing running, never hold the queue back on load alone
+    if (running > 0 && max_load > 0) {
+        double load = read_loadavg();
+        if (load >= 0 && load > max_load) return 0;
+    }
+    if (running > 0 && max_pressure > 0) {
+        double p = read_cpu_pressure();
+        if (p >= 0 && p > max_pressure) return 0;
+    }
+    return 1;
+}
+
+int jobs_admit(void) {
+    for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
+        if (jobs[i].in_use && jobs[i].state == QUEUED) return 0; // keep the queue's order
+    }
+    return free_slot() >= 0 && room_to_start();
+}
+
+int jobs_queue(const struct command *cmd, const char *cmdline) {
+    int idx = free_slot();
+    if (idx < 0) return -1;
+
+    job_t *j = &jobs[idx];
+    memset(j, 0, sizeof(*j));
+    if (!copy_command(cmd, &j->cmd)) return -1;
+    j->cmdline = strdup(cmdline ? cmdline : "");
+    if (!j->cmdline) {
+        free_command(&j->cmd);
+        return -1;
+    }
+    j->in_use = 1;
+    j->id = next_id++;
+    j->pgid = 0;
+    j->pid = -1;
+    j->pidfd = -1;
+    j->cg = -1;
+    j->state = QUEUED;
+    j->marker = 2;
+    j->prio = queue_prio;
+    j->seq = queue_seq++;
+    return j->id;
+}
+
+// highest priority queued job, oldest first among equals
+static int next_queued(void) {
+    int best = -1;
+    for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
+        if (!jobs[i].in_use || jobs[i].state != QUEUED) continue;
+        if (best < 0 || jobs[i].prio > jobs[best].prio ||
+            (jobs[i].prio == jobs[best].prio && jobs[i].seq < jobs[best].seq)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+void jobs_poll(void) {
+    reap();
+    if (!launcher) return;
+
+    int slot;
+    while ((slot = next_queued()) >= 0 && room_to_start()) {
+        job_t *j = &jobs[slot];
+        pid_t pid = launcher(&j->cmd, &j->cg);
+        free_command(&j->cmd);
+        if (pid < 0) {
+            j->state = DONE; // could not start, report it like a failed command
+            j->status = 1;
+            continue;
+        }
+        j->pid = j->pgid = pid;
+        j->pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+        j->state = RUNNING;
+        make_current(slot);
+    }
+}
+
+void jobs_attach_cgroup(int id, int cg) {
+    for (int i = 0; i < JOBS_TABLE_SIZE; i++) {
+        if (jobs[i].in_use && jobs[i].id == id) {
+            jobs[i].cg = cg;
+            return;
+        }
+    }
+    cgroup_job_destroy(cg);
+}
+
+int jobs_signal(int slot, int sig) {
+    if (slot < 0 || slot >= JOBS_TABLE_SIZE || !jobs[slot].in_use) return -1;
+    job_t *j = &jobs[slot];
+
+    if (j->state == QUEUED) {
+        // never started: just take it out of the queue
+        free_command(&j->cmd);
+        j->state = DONE;
+        j->status = 128 + sig;
+        return 0;
+    }
+    if (j->state == DONE) return 0;
+
+    // SIGKILL through cgroup.kill also gets processes that left the group
+    if (sig == SIGKILL && cgroup_job_kill(j->cg) == 0) return 0;
+
+    if (kill(-j->pgid, sig) < 0) return -1;
+    // a stopped job only sees the signal once it runs again
+    if (j->state == STOPPED && sig != SIGSTOP && sig != SIGTSTP && sig != SIGCONT) {
+        kill(-j->pgid, SIGCONT);
+    }
+    return 0;
+}
@@ -2,13 +2,22 @@
 #define JOBS_H
 
 #include <sys/types.h>
+#include "parser.h"
 
-typedef enum { RUNNING, STOPPED, DONE } job_state_t;
+#define MAX_JOBS 20             // default limit on background jobs running at once
+#define JOBS_TABLE_SIZE 128     // running, stopped and queued jobs together
+
+typedef enum { RUNNING, STOPPED, DONE, QUEUED } job_state_t;
+
+// starts a queued command as a new process group, returns its pid or -1
+// and its job cgroup (-1 without one) in *cg_out
+typedef pid_t (*job_launcher_t)(struct command *cmd, int *cg_out);
 
 void jobs_init(void);
 int  jobs_add(pid_t pgid, const pid_t *pids, int npids, const char *cmdline, job_state_t st);
 void jobs_reap_and_report(void);
-void jobs_print(void);
+// verbose (jobs -l) adds pids and, for jobs in a cgroup, memory and pressure
+void jobs_print(int verbose);
 int jobs_get_current(pid_t *pgid_out, job_state_t *state_out, const char **cmd_out, int *slot_out);
 void jobs_set_state(int slot, job_state_t st);
 void jobs_remove(int slot);
@@ -21,5 +30,62 @@ void jobs_mark_running(int slot);
 
 int jobs_has_capacity(void);
 
+// slot of the job named by "%N" (job id) or a pid, -1 if there is none
+int jobs_find(const char *spec);
+
+// fills slots with every RUNNING or QUEUED job, returns how many
+int jobs_running_slots(int *slots, int max);
+
+// exit status of a DONE job (128+sig if killed), -1 if it hasn't finished
+int jobs_exit_status(int slot);
+
+// blocks until every job in slots is DONE, or the first one if any is set,
+// polling the jobs' pidfds so we wake as soon as a child exits
+// finished jobs stay in the table as DONE (reported at the next prompt)
+// returns the slot that finished last (or first, with any), -1 if none did,
+// -2 if a signal interrupted the wait, -3 if one of them is stopped
+// queued jobs in slots are started as room frees up while we wait
+int jobs_wait(const int *slots, int n, int any);
+
+/* ---------- admission control for background jobs ---------- */
+
+// how queued jobs get started (set once at startup)
+void jobs_set_launcher(job_launcher_t fn);
+
+// 1 if a new background job may start right now: a free slot, fewer than
+// maxjobs running, nothing already queued ahead of it, and the load average /
+// CPU pressure (when limits are set) under their thresholds
+int jobs_admit(void);
+
+// adds a command that may not start yet as a QUEUED job, taking a copy of cmd
+// returns the job id, or -1 if the table is full
+int jobs_queue(const struct command *cmd, const char *cmdline);
+
+// reaps finished children without printing and starts queued jobs that are
+// now admitted; safe to call often (between commands, while idle at the prompt)
+void jobs_poll(void);
+
+// admission settings, from "set -o"; a limit <= 0 disables the load/pressure checks
+void jobs_set_max_running(int n);
+int  jobs_get_max_running(void);
+void jobs_set_max_load(double load);
+double jobs_get_max_load(void);
+void jobs_set_max_pressure(double avg10);
+double jobs_get_max_pressure(void);
+
+// priority given to jobs queued from now on, higher ones start first
+void jobs_set_queue_priority(int prio);
+int  jobs_get_queue_priority(void);
+
+/* ---------- cgroups ---------- */
+
+// hands a job cgroup (cgroup.c) to job id, which removes it with the job
+void jobs_attach_cgroup(int id, int cg);
+
+// sends sig to a job's process group (continuing it if stopped); SIGKILL goes
+// through cgroup.kill when the job has a cgroup, and a queued job is just dropped
+// returns 0 on success, -1 on failure
+int jobs_signal(int slot, int sig);
+
 
 #endif
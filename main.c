@@ -8,14 +8,43 @@
 #include <sys/types.h>
 #include <string.h>
 #include "jobs.h"
+#include "eval.h"
+#include "zygote.h"
+#include "vars.h"
+#include "cgroup.h"
+#include "serve.h"
+
+extern char **environ;
+
+// readline calls this while idle at the prompt, so queued jobs start
+// as soon as running ones finish instead of at the next command
+static int idle_hook(void) {
+    jobs_poll();
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int use_zygote = 0;
+    const char *serve_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-z") == 0 || strcmp(argv[i], "--zygote") == 0) {
+            use_zygote = 1;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-z|--zygote] [--serve socket]\n", argv[0]);
+            return 2;
+        }
+    }
 
-int main(void) {
     signal(SIGINT, SIG_IGN); //ignore interrupt signal (crtl c)
     signal(SIGTSTP, SIG_IGN); //ignore stop signal (crtl z)
     signal(SIGTTOU, SIG_IGN);
     signal(SIGTTIN, SIG_IGN);
 
     jobs_init();
+    jobs_set_launcher(exec_launch_background);
+    vars_init(environ);
 
     // this makes sure the shell is its own process group leader
     setpgid(0, 0);
@@ -23,60 +52,72 @@ int main(void) {
     tcsetpgrp(STDIN_FILENO, getpgrp());
     exec_set_shell_pgid(getpgrp());
 
+    // -z / --zygote: fork the launcher helper now, while the shell is still small
+    // (after the signal setup, so ctrl-c at the prompt doesn't kill it)
+    if (use_zygote && zygote_start() < 0) {
+        fprintf(stderr, "yash: could not start launcher helper\n");
+    }
+
+
+    // --serve: no prompt, requests come in over the socket (serve.c)
+    if (serve_path) {
+        int status = serve_main(serve_path);
+        zygote_stop();
+        cgroup_cleanup();
+        return status;
+    }
+
+    // only on a terminal: with piped input readline would keep polling at EOF
+    if (isatty(STDIN_FILENO)) rl_event_hook = idle_hook;
+
+    char *script = NULL; // text of a compound command still being typed
 
     while(1) {
-        jobs_reap_and_report();
-        char *line = readline("# ");
+        if (script == NULL) {
+            jobs_reap_and_report();
+        }
+        char *line = readline(script ? "> " : "# ");
         if (line == NULL){
             break; // Ctrl-D will exit shell
         }
-        if (line[0] == '\0') { 
+        if (script == NULL && line[0] == '\0') { 
             free(line); 
             continue; 
         }
 
-        struct command cmd;
-        if (parse_command(line, &cmd)) {
-            if (cmd.has_pipe) {
-                run_single_pipeline(&cmd);
-            } else if (cmd.argv && cmd.argv[0] && strcmp(cmd.argv[0], "jobs") == 0) {
-                jobs_print();
-            } else if (cmd.argv && cmd.argv[0] && strcmp(cmd.argv[0], "fg") == 0){
-                pid_t pgid; 
-                job_state_t st; 
-                const char *cmdtxt; 
-                int slot;
-                if (jobs_get_current(&pgid, &st, &cmdtxt, &slot) == 0) {
-                    exec_foreground_job(pgid, slot, st, cmdtxt);
-                } else {
-                    // no current job
-                    putchar('\n');
-                }
-            } else if (cmd.argv && cmd.argv[0] && strcmp(cmd.argv[0], "bg") == 0){
-                pid_t pgid; 
-                int slot; 
-                const char *txt; 
-                int id;
-                if (jobs_get_current_stopped(&pgid, &slot, &txt, &id) == 0) {
-                    // resume in background and send SIGCONT to the whole process group
-                    kill(-pgid, SIGCONT);
-                    jobs_mark_running(slot);
-                    printf("[%d]+  Running  %s \n", id, txt);
-                } else {
-                    //nothing to bg
-                    putchar('\n');
-                }
-            } else if (cmd.background){
-                run_single_background(&cmd, line);
-            } else {
-                run_simple_foreground(&cmd, line);
+        // keep appending lines while a for/while/if is still open
+        if (script != NULL) {
+            size_t len = strlen(script) + strlen(line) + 2;
+            char *joined = malloc(len);
+            if (joined == NULL) {
+                free(script);
+                free(line);
+                script = NULL;
+                continue;
             }
-            free_command(&cmd);
+            snprintf(joined, len, "%s\n%s", script, line);
+            free(script);
+            free(line);
+            line = joined;
+            script = NULL;
+        }
+
+        struct node *tree;
+        int rc = parse_script(line, &tree);
+        if (rc > 0) {
+            eval_script(tree);
+            free_script(tree);
+        } else if (rc < 0) {
+            script = line; // incomplete, wait for more input
+            continue;
         } else {
             putchar('\n');
         }
 
         free(line);
     }
+    free(script);
+    zygote_stop();
+    cgroup_cleanup();
     return 0;
 }
@@ -1,16 +1,96 @@
 #include "parser.h"
+#include "vars.h"
+#include "pathexp.h"
+#include "subst.h"
 #include <string.h>
 #include <stdlib.h>
 
+// parses a redirection operator token like "<", "2>", ">>", "2>&1" or "<&-"
+// fills r (path is left NULL); returns 1 if tok is a redirection, 0 otherwise
+// *rest points to any text glued after the operator (a file name or "&...")
+static int parse_redir_op(const char *tok, struct redir *r, const char **rest) {
+    const char *p = tok;
+    int fd = -1;
+    if (*p >= '0' && *p <= '9') {
+        fd = 0;
+        while (*p >= '0' && *p <= '9') {
+            fd = fd * 10 + (*p - '0');
+            if (fd > 1024) return 0;
+            p++;
+        }
+    }
+    if (*p == '<') {
+        r->kind = REDIR_IN;
+        r->fd = fd < 0 ? 0 : fd;
+        p++;
+    } else if (*p == '>') {
+        r->kind = REDIR_OUT;
+        r->fd = fd < 0 ? 1 : fd;
+        p++;
+        if (*p == '>') {
+            r->kind = REDIR_APPEND;
+            p++;
+        }
+    } else {
+        return 0;
+    }
+    r->path = NULL;
+    r->target = -1;
+    *rest = p;
+    return 1;
+}
+
 static int is_special(const char *tok){
+    struct redir r;
+    const char *rest;
     return tok && 
-            (strcmp(tok, "<") == 0 ||
-            strcmp(tok, ">") == 0 ||
-            strcmp(tok, "2>") == 0 ||
+            (parse_redir_op(tok, &r, &rest) ||
             strcmp(tok, "|") == 0 ||
             strcmp(tok, "&") == 0);
 }
 
+// if p starts a $(...) or `...`, returns the char just past its end, or NULL
+// if it isn't closed (yet); any other p is returned as is
+static const char *skip_subst(const char *p) {
+    if (*p == '`') {
+        const char *close = strchr(p + 1, '`');
+        return close ? close + 1 : NULL;
+    }
+    if (p[0] != '$' || p[1] != '(') return p;
+    int depth = 0;
+    for (const char *c = p + 1; *c; c++) {
+        if (*c == '`') {
+            c = skip_subst(c);
+            if (!c) return NULL;
+            c--;
+        } else if (*c == '(') {
+            depth++;
+        } else if (*c == ')' && --depth == 0) {
+            return c + 1;
+        }
+    }
+    return NULL;
+}
+
+// strtok_r() that keeps a command substitution in one token, blanks and all
+static char *word_tok_r(char *str, const char *delims, char **saveptr) {
+    char *p = str ? str : *saveptr;
+    p += strspn(p, delims);
+    if (*p == '\0') {
+        *saveptr = p;
+        return NULL;
+    }
+    char *start = p;
+    while (*p && !strchr(delims, *p)) {
+        const char *end = skip_subst(p);
+        if (!end) end = p + strlen(p); // unclosed, the rest of the line
+        p = end == p ? p + 1 : (char *)end;
+    }
+    if (*p) *p++ = '\0';
+    *saveptr = p;
+    return start;
+}
+
 static void free_temp_argv(char **arr, int count) {
     if (!arr) return;
     for (int i = 0; i < count; i++) free(arr[i]);
@@ -24,8 +104,9 @@ int parse_command(const char *line, struct command *cmd) {
 
     cmd->argv=NULL; 
     cmd->pipe_argv=NULL;
-    cmd->infile=cmd->outfile=cmd->errfile=NULL;
-    cmd->pipe_infile=cmd->pipe_outfile=cmd->pipe_errfile=NULL;
+    cmd->redirs=NULL;
+    cmd->pipe_redirs=NULL;
+    cmd->nredirs=cmd->pipe_nredirs=0;
     cmd->has_pipe=0; 
     cmd->background=0;
 
@@ -37,7 +118,7 @@ int parse_command(const char *line, struct command *cmd) {
 
     const char *delims = " \t\r\n";
     char *saveptr = NULL;
-    char *curr_tok = strtok_r(buf, delims, &saveptr);
+    char *curr_tok = word_tok_r(buf, delims, &saveptr);
 
     // Dynamic arrays for left and right side
     char **left_argv = NULL;
@@ -57,24 +138,8 @@ int parse_command(const char *line, struct command *cmd) {
             return 0;
         }
         if(is_special(curr_tok)){
-            if (strcmp(curr_tok, "<") == 0) {
-                if(handle_input_redirection(cmd, curr_tok, &saveptr, delims, parsing_side) == 0){
-                    free_temp_argv(left_argv, left_count);
-                    free_temp_argv(right_argv, right_count);
-                    free(buf);
-                    free_command(cmd);
-                    return 0;
-                }
-            } else if (strcmp(curr_tok, ">") == 0) {
-                if(handle_output_redirection(cmd, curr_tok, &saveptr, delims, parsing_side) == 0){
-                    free_temp_argv(left_argv, left_count);
-                    free_temp_argv(right_argv, right_count);
-                    free(buf);
-                    free_command(cmd);
-                    return 0;
-                }
-            } else if (strcmp(curr_tok, "2>") == 0) {
-                if(handle_error_redirection(cmd, curr_tok, &saveptr, delims, parsing_side) == 0){
+            if (strcmp(curr_tok, "|") != 0 && strcmp(curr_tok, "&") != 0) {
+                if(handle_redirection(cmd, curr_tok, &saveptr, delims, parsing_side) == 0){
                     free_temp_argv(left_argv, left_count);
                     free_temp_argv(right_argv, right_count);
                     free(buf);
@@ -161,7 +226,7 @@ int parse_command(const char *line, struct command *cmd) {
                 right_count++;
             }
         }
-        curr_tok = strtok_r(NULL, delims, &saveptr);
+        curr_tok = word_tok_r(NULL, delims, &saveptr);
     }
 
     // Null  terminate arrays
@@ -191,6 +256,11 @@ int parse_command(const char *line, struct command *cmd) {
     return 1;
 }
 
+static void free_redirs(struct redir *redirs, int count) {
+    for (int i = 0; i < count; i++) free(redirs[i].path);
+    free(redirs);
+}
+
 void free_command(struct command *cmd) {
     if (cmd == NULL) {
         return;
@@ -204,10 +274,8 @@ void free_command(struct command *cmd) {
         free(cmd->argv);
     }
     
-    // Free left side redirection filenames
-    if (cmd->infile) free(cmd->infile);
-    if (cmd->outfile) free(cmd->outfile);
-    if (cmd->errfile) free(cmd->errfile);
+    // Free left side redirections
+    free_redirs(cmd->redirs, cmd->nredirs);
     
     // Free right side argv (if pipe exists)
     if (cmd->has_pipe && cmd->pipe_argv != NULL) {
@@ -217,97 +285,698 @@ void free_command(struct command *cmd) {
         free(cmd->pipe_argv);
     }
     
-    // Free right side redirection filenames
-    if (cmd->pipe_infile) free(cmd->pipe_infile);
-    if (cmd->pipe_outfile) free(cmd->pipe_outfile);
-    if (cmd->pipe_errfile) free(cmd->pipe_errfile);
+    // Free right side redirections
+    free_redirs(cmd->pipe_redirs, cmd->pipe_nredirs);
 }
 
-// Helper function to handle input redirection (<)
-int handle_input_redirection(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side) {
-    // Get the next token (filename)
-    char *filename = strtok_r(NULL, delims, saveptr);
-    if(filename == NULL){
-        return 0; //missing filename
+// Helper function to handle any redirection (<, >, >>, n>, n>&m, n<&-, ...)
+// the file name may be glued to the operator (">out") or be the next token
+int handle_redirection(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side) {
+    struct redir r;
+    const char *rest;
+    if (!parse_redir_op(curr_tok, &r, &rest)) {
+        return 0;
     }
-    
-    if (parsing_side == 0) {
-        if(cmd->infile != NULL){
-            return 0; //multiple input redirections
+
+    if (*rest == '&') {
+        rest++;
+        if (strcmp(rest, "-") == 0) {
+            r.kind = REDIR_CLOSE;
+        } else if (*rest >= '0' && *rest <= '9') {
+            char *end;
+            long target = strtol(rest, &end, 10);
+            if (*end != '\0' || target > 1024) {
+                return 0; //not a plain fd number
+            }
+            r.kind = REDIR_DUP;
+            r.target = (int)target;
+        } else if (vars_valid_name(rest, strlen(rest))) {
+            // looked up when applied, the coprocess may not exist yet
+            r.target = r.kind != REDIR_IN;
+            r.kind = REDIR_COPROC;
+            r.path = strdup(rest);
+            if (r.path == NULL) {
+                return 0;
+            }
+        } else {
+            return 0; //missing or bad fd after &
         }
-        cmd->infile = strdup(filename);
-        return cmd->infile != NULL;
-    } else if (parsing_side == 1) {
-        if(cmd->pipe_infile != NULL){
-            return 0; //multiple input redirections
+    } else {
+        const char *filename = *rest ? rest : word_tok_r(NULL, delims, saveptr);
+        if (filename == NULL || is_special(filename)) {
+            return 0; //missing filename
         }
-        cmd->pipe_infile = strdup(filename);
-        return cmd->pipe_infile != NULL;
+        r.path = strdup(filename);
+        if (r.path == NULL) {
+            return 0;
+        }
+    }
+
+    struct redir **list;
+    int *count;
+    if (parsing_side == 0) {
+        list = &cmd->redirs;
+        count = &cmd->nredirs;
+    } else if (parsing_side == 1) {
+        list = &cmd->pipe_redirs;
+        count = &cmd->pipe_nredirs;
     } else {
+        free(r.path);
         return 0; //invalid parsing side
     }
+
+    struct redir *grown = realloc(*list, sizeof(struct redir) * (*count + 1));
+    if (grown == NULL) {
+        free(r.path);
+        return 0;
+    }
+    grown[*count] = r;
+    *list = grown;
+    (*count)++;
+    return 1;
 }
 
-// Helper function to handle output redirection (>)
-int handle_output_redirection(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side) {
-    // Get the next token (filename)
-    char *filename = strtok_r(NULL, delims, saveptr);
-    if (filename == NULL){
-        return 0; //missing filename
+// Helper function to handle pipes (|)
+int handle_pipe(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side) {
+    if(cmd->has_pipe) return 0; //if has_pipe is already been set and we are here, that means there are 2 pipes, we exit and fail
+    cmd->has_pipe = 1;
+    return 1;
+}
+
+// Helper function to handle background (&) - placeholder for now
+int handle_background(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side) {
+    cmd->background = 1;
+    return 1;
+}
+
+
+
+/* ---------- word expansion ---------- */
+
+struct sbuf {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+};
+
+static void sbuf_add(struct sbuf *b, const char *s, size_t n) {
+    if (b->failed) return;
+    if (b->len + n + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap : 32;
+        while (cap < b->len + n + 1) cap *= 2;
+        char *grown = realloc(b->data, cap);
+        if (!grown) {
+            b->failed = 1;
+            return;
+        }
+        b->data = grown;
+        b->cap = cap;
     }
-    
-    if (parsing_side == 0) {
-        if(cmd->outfile != NULL){
-            return 0; //multiple output redirections
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+}
+
+static void sbuf_add_var(struct sbuf *b, const char *name, size_t len) {
+    char *key = strndup(name, len);
+    if (!key) {
+        b->failed = 1;
+        return;
+    }
+    const char *value = vars_get(key);
+    free(key);
+    if (value) sbuf_add(b, value, strlen(value));
+}
+
+// ends the word being built by b, moving it to the end of *fields
+static void sbuf_end_field(struct sbuf *b, char ***fields, int *nfields) {
+    if (b->failed) return;
+    char **grown = realloc(*fields, sizeof(char*) * (*nfields + 2));
+    if (!grown) {
+        b->failed = 1;
+        return;
+    }
+    *fields = grown;
+    grown[(*nfields)++] = b->data;
+    grown[*nfields] = NULL;
+    memset(b, 0, sizeof(*b));
+    sbuf_add(b, "", 0);
+}
+
+// output of a command substitution; with fields set it is split on blanks, so
+// "a$(echo 1 2)b" becomes the words "a1" and "2b"
+static void sbuf_add_subst(struct sbuf *b, const char *script, size_t len, char ***fields, int *nfields) {
+    char *out = subst_run(script, len);
+    if (!out) {
+        b->failed = 1;
+        return;
+    }
+    if (!fields) {
+        sbuf_add(b, out, strlen(out));
+        free(out);
+        return;
+    }
+    const char *p = out;
+    while (*p) {
+        size_t word = strcspn(p, " \t\n");
+        sbuf_add(b, p, word);
+        p += word;
+        if (*p == '\0') break;
+        p += strspn(p, " \t\n");
+        sbuf_end_field(b, fields, nfields);
+    }
+    free(out);
+}
+
+// expands word into a new string, the last of its words when a command
+// substitution split it (fields != NULL); the others go to *fields
+static char *expand_fields(const char *word, char ***fields, int *nfields) {
+    struct sbuf b = {0};
+    sbuf_add(&b, "", 0);
+
+    const char *p = word;
+    while (*p) {
+        const char *special = strpbrk(p, "$`");
+        if (!special) {
+            sbuf_add(&b, p, strlen(p));
+            break;
         }
-        cmd->outfile = strdup(filename);
-        return cmd->outfile != NULL;
-    } else if (parsing_side == 1) {
-        if(cmd->pipe_outfile != NULL){
-            return 0; //multiple output redirections
+        sbuf_add(&b, p, special - p);
+
+        const char *end = skip_subst(special);
+        if (end && end != special) {
+            size_t open = *special == '`' ? 1 : 2; // "`" or "$("
+            sbuf_add_subst(&b, special + open, end - special - open - 1, fields, nfields);
+            p = end;
+            continue;
         }
-        cmd->pipe_outfile = strdup(filename);
-        return cmd->pipe_outfile != NULL;
-    } else {
+        p = special + 1;
+        if (*special == '`') {
+            sbuf_add(&b, "`", 1); // unclosed, keep it literally
+            continue;
+        }
+
+        if (*p == '?' || *p == '$') {
+            sbuf_add_var(&b, p, 1);
+            p++;
+        } else if (*p == '{') {
+            const char *close = strchr(p, '}');
+            if (close && vars_valid_name(p + 1, close - p - 1)) {
+                sbuf_add_var(&b, p + 1, close - p - 1);
+                p = close + 1;
+            } else {
+                sbuf_add(&b, "$", 1); // not a ${NAME}, keep it literally
+            }
+        } else {
+            const char *end = p;
+            while (vars_valid_name(p, end - p + 1)) end++;
+            if (end == p) {
+                sbuf_add(&b, "$", 1); // lone '$'
+            } else {
+                sbuf_add_var(&b, p, end - p);
+                p = end;
+            }
+        }
+    }
+
+    if (b.failed) {
+        free(b.data);
+        return NULL;
+    }
+    return b.data;
+}
+
+char *expand_word(const char *word) {
+    return expand_fields(word, NULL, NULL);
+}
+
+// adds one expanded word to out (taking it over): dropped when empty,
+// replaced by its matches when it is a pattern that matches something
+static int add_word(char *w, char ***out, int *n) {
+    if (w[0] == '\0') {
+        free(w);
+        return 1;
+    }
+    // pathname expansion; a pattern with no match stays as typed
+    if (pathexp_has_glob(w)) {
+        int found = pathexp_expand(w, out, n);
+        if (found != 0) {
+            free(w);
+            return found > 0;
+        }
+    }
+    char **grown = realloc(*out, sizeof(char*) * (*n + 2));
+    if (!grown) {
+        free(w);
         return 0;
     }
+    *out = grown;
+    grown[(*n)++] = w;
+    grown[*n] = NULL;
+    return 1;
 }
 
-// Helper function to handle error redirection (2>)
-int handle_error_redirection(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side) {
-    // Get the next token (filename)
-    char *filename = strtok_r(NULL, delims, saveptr);
-    if (filename == NULL){
-        return 0; //missing filename
+int expand_words(char **src, char ***dst) {
+    *dst = NULL;
+    if (!src) return 1;
+
+    char **out = malloc(sizeof(char*));
+    int n = 0;
+    if (!out) return 0;
+    out[0] = NULL;
+    for (int i = 0; src[i]; i++) {
+        // NAME=$(cmd) stays one word, like an assignment should
+        const char *eq = strchr(src[i], '=');
+        int split = !(eq && vars_valid_name(src[i], eq - src[i]));
+
+        char **fields = NULL;
+        int nfields = 0;
+        char *w = expand_fields(src[i], split ? &fields : NULL, &nfields);
+        int ok = w != NULL;
+        for (int j = 0; j < nfields; j++) {
+            if (ok) ok = add_word(fields[j], &out, &n);
+            else free(fields[j]);
+        }
+        free(fields);
+        if (w) {
+            if (ok) ok = add_word(w, &out, &n);
+            else free(w);
+        }
+        if (!ok) {
+            free_temp_argv(out, n);
+            return 0;
+        }
     }
-    
-    if (parsing_side == 0) {
-        if(cmd->errfile != NULL){
-            return 0; //multiple error redirections
+    *dst = out;
+    return 1;
+}
+
+static int expand_redirs(const struct redir *src, int count, struct redir **dst) {
+    *dst = NULL;
+    if (count == 0) return 1;
+    struct redir *out = calloc(count, sizeof(*out));
+    if (!out) return 0;
+    for (int i = 0; i < count; i++) {
+        out[i] = src[i];
+        if (src[i].path) {
+            out[i].path = expand_word(src[i].path);
+            if (!out[i].path) {
+                free_redirs(out, i);
+                return 0;
+            }
         }
-        cmd->errfile = strdup(filename);
-        return cmd->errfile != NULL;
-    } else if (parsing_side == 1) {
-        if(cmd->pipe_errfile != NULL){
-            return 0; //multiple error redirections
+    }
+    *dst = out;
+    return 1;
+}
+
+int expand_command(const struct command *src, struct command *dst) {
+    memset(dst, 0, sizeof(*dst));
+    dst->has_pipe = src->has_pipe;
+    dst->background = src->background;
+
+    int ok = 0;
+    if (!expand_words(src->argv, &dst->argv) ||
+        !expand_redirs(src->redirs, src->nredirs, &dst->redirs)) {
+        goto out;
+    }
+    dst->nredirs = src->nredirs;
+    if (!expand_words(src->pipe_argv, &dst->pipe_argv) ||
+        !expand_redirs(src->pipe_redirs, src->pipe_nredirs, &dst->pipe_redirs)) {
+        goto out;
+    }
+    dst->pipe_nredirs = src->pipe_nredirs;
+    ok = 1;
+out:
+    if (!ok) free_command(dst);
+    // listings are only shared within one command, the next one may see new files
+    pathexp_cache_clear();
+    return ok;
+}
+
+static int copy_words(char **src, char ***dst) {
+    *dst = NULL;
+    if (!src) return 1;
+    int n = 0;
+    while (src[n]) n++;
+    char **out = calloc(n + 1, sizeof(char*));
+    if (!out) return 0;
+    for (int i = 0; i < n; i++) {
+        out[i] = strdup(src[i]);
+        if (!out[i]) {
+            free_temp_argv(out, i);
+            return 0;
         }
-        cmd->pipe_errfile = strdup(filename);
-        return cmd->pipe_errfile != NULL;
-    } else {
+    }
+    *dst = out;
+    return 1;
+}
+
+static int copy_redirs(const struct redir *src, int count, struct redir **dst) {
+    *dst = NULL;
+    if (count == 0) return 1;
+    struct redir *out = calloc(count, sizeof(*out));
+    if (!out) return 0;
+    for (int i = 0; i < count; i++) {
+        out[i] = src[i];
+        if (src[i].path && !(out[i].path = strdup(src[i].path))) {
+            free_redirs(out, i);
+            return 0;
+        }
+    }
+    *dst = out;
+    return 1;
+}
+
+int copy_command(const struct command *src, struct command *dst) {
+    memset(dst, 0, sizeof(*dst));
+    dst->has_pipe = src->has_pipe;
+    dst->background = src->background;
+
+    if (!copy_words(src->argv, &dst->argv) ||
+        !copy_redirs(src->redirs, src->nredirs, &dst->redirs)) {
+        free_command(dst);
         return 0;
     }
+    dst->nredirs = src->nredirs;
+    if (!copy_words(src->pipe_argv, &dst->pipe_argv) ||
+        !copy_redirs(src->pipe_redirs, src->pipe_nredirs, &dst->pipe_redirs)) {
+        free_command(dst);
+        return 0;
+    }
+    dst->pipe_nredirs = src->pipe_nredirs;
+    return 1;
+}
+
+/* ---------- script parsing (lists, for/while/if) ---------- */
+
+typedef enum { KW_NONE, KW_IF, KW_THEN, KW_ELIF, KW_ELSE, KW_FI, KW_WHILE, KW_FOR, KW_DO, KW_DONE } keyword_t;
+
+// one piece of a script: either a keyword or a plain command
+struct stoken {
+    keyword_t kw;
+    char *text;     // KW_NONE: command text, KW_FOR: loop header, else NULL
+};
+
+struct sparser {
+    struct stoken *toks;
+    int count;
+    int capacity;
+    int pos;
+    int incomplete; // set when we ran out of tokens mid-construct
+};
+
+static keyword_t keyword_of(const char *word, size_t len) {
+    static const struct { const char *name; keyword_t kw; } table[] = {
+        {"if", KW_IF}, {"then", KW_THEN}, {"elif", KW_ELIF}, {"else", KW_ELSE}, {"fi", KW_FI},
+        {"while", KW_WHILE}, {"for", KW_FOR}, {"do", KW_DO}, {"done", KW_DONE},
+    };
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+        if (strlen(table[i].name) == len && strncmp(table[i].name, word, len) == 0) {
+            return table[i].kw;
+        }
+    }
+    return KW_NONE;
 }
 
-// Helper function to handle pipes (|)
-int handle_pipe(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side) {
-    if(cmd->has_pipe) return 0; //if has_pipe is already been set and we are here, that means there are 2 pipes, we exit and fail
-    cmd->has_pipe = 1;
+static int push_stoken(struct sparser *p, keyword_t kw, const char *text, size_t len) {
+    if (p->count >= p->capacity) {
+        int cap = p->capacity ? p->capacity * 2 : 8;
+        struct stoken *t = realloc(p->toks, sizeof(*t) * cap);
+        if (!t) return 0;
+        p->toks = t;
+        p->capacity = cap;
+    }
+    p->toks[p->count].kw = kw;
+    p->toks[p->count].text = NULL;
+    if (text) {
+        p->toks[p->count].text = strndup(text, len);
+        if (!p->toks[p->count].text) return 0;
+    }
+    p->count++;
     return 1;
 }
 
-// Helper function to handle background (&) - placeholder for now
-int handle_background(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side) {
-    cmd->background = 1;
+// splits one ';'/newline separated segment into keywords and a trailing command
+// e.g. "do if true" -> KW_DO, KW_IF, "true"
+static int tokenize_segment(struct sparser *p, const char *seg, size_t len) {
+    const char *end = seg + len;
+    while (1) {
+        while (seg < end && (*seg == ' ' || *seg == '\t' || *seg == '\r')) seg++;
+        while (end > seg && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+        if (seg == end) return 1;
+
+        const char *w = seg;
+        while (w < end && *w != ' ' && *w != '\t' && *w != '\r') w++;
+        keyword_t kw = keyword_of(seg, w - seg);
+
+        if (kw == KW_NONE) {
+            return push_stoken(p, KW_NONE, seg, end - seg);
+        }
+        if (kw == KW_FOR) {
+            // the rest of the segment is the loop header ("x in a b c")
+            while (w < end && (*w == ' ' || *w == '\t')) w++;
+            return push_stoken(p, KW_FOR, w, end - w);
+        }
+        if (!push_stoken(p, kw, NULL, 0)) return 0;
+        if ((kw == KW_FI || kw == KW_DONE) && w != end) {
+            return 0; // nothing may follow a closing keyword in the same segment
+        }
+        seg = w;
+    }
+}
+
+static void free_stokens(struct sparser *p) {
+    for (int i = 0; i < p->count; i++) free(p->toks[i].text);
+    free(p->toks);
+}
+
+static keyword_t peek_kw(struct sparser *p) {
+    if (p->pos >= p->count) return KW_NONE;
+    return p->toks[p->pos].kw;
+}
+
+// consume the expected keyword, flagging incomplete input if we ran out
+static int expect_kw(struct sparser *p, keyword_t kw) {
+    if (p->pos >= p->count) {
+        p->incomplete = 1;
+        return 0;
+    }
+    if (p->toks[p->pos].kw != kw) return 0;
+    p->pos++;
     return 1;
 }
 
+// an empty list is an error, unless we simply have not seen the rest yet
+static int present(struct sparser *p, struct node *list) {
+    if (list) return 1;
+    if (p->pos >= p->count) p->incomplete = 1;
+    return 0;
+}
+
+static struct node *new_node(node_type_t type) {
+    struct node *n = calloc(1, sizeof(*n));
+    if (n) n->type = type;
+    return n;
+}
+
+static struct node *parse_list(struct sparser *p, int *ok);
+
+static struct node *parse_if_tail(struct sparser *p, int *ok) {
+    struct node *n = new_node(NODE_IF);
+    if (!n) { *ok = 0; return NULL; }
+
+    n->cond = parse_list(p, ok);
+    if (!*ok || !present(p, n->cond) || !expect_kw(p, KW_THEN)) goto fail;
+    n->body = parse_list(p, ok);
+    if (!*ok || !present(p, n->body)) goto fail;
+
+    if (peek_kw(p) == KW_ELIF) {
+        p->pos++;
+        n->alt = parse_if_tail(p, ok); // elif owns the closing 'fi'
+        if (!*ok) goto fail;
+        return n;
+    }
+    if (peek_kw(p) == KW_ELSE) {
+        p->pos++;
+        n->alt = parse_list(p, ok);
+        if (!*ok || !present(p, n->alt)) goto fail;
+    }
+    if (!expect_kw(p, KW_FI)) goto fail;
+    return n;
+
+fail:
+    *ok = 0;
+    free_script(n);
+    return NULL;
+}
+
+static struct node *parse_for(struct sparser *p, const char *header, int *ok) {
+    struct node *n = new_node(NODE_FOR);
+    if (!n) { *ok = 0; return NULL; }
+
+    char *buf = strdup(header);
+    if (!buf) goto fail;
+    char *saveptr = NULL;
+    const char *delims = " \t";
+    char *var = word_tok_r(buf, delims, &saveptr);
+    char *in = word_tok_r(NULL, delims, &saveptr);
+    if (!var || !in || strcmp(in, "in") != 0) {
+        free(buf);
+        goto fail;
+    }
+    n->var = strdup(var);
+    int count = 0, capacity = 4;
+    n->words = malloc(sizeof(char*) * (capacity + 1));
+    if (!n->var || !n->words) {
+        free(buf);
+        goto fail;
+    }
+    n->words[0] = NULL;
+    char *w;
+    while ((w = word_tok_r(NULL, delims, &saveptr)) != NULL) {
+        if (count >= capacity) {
+            capacity *= 2;
+            char **grown = realloc(n->words, sizeof(char*) * (capacity + 1));
+            if (!grown) { free(buf); goto fail; }
+            n->words = grown;
+        }
+        n->words[count] = strdup(w);
+        if (!n->words[count]) { free(buf); goto fail; }
+        n->words[++count] = NULL;
+    }
+    free(buf);
+
+    if (!expect_kw(p, KW_DO)) goto fail;
+    n->body = parse_list(p, ok);
+    if (!*ok || !present(p, n->body) || !expect_kw(p, KW_DONE)) goto fail;
+    return n;
+
+fail:
+    *ok = 0;
+    free_script(n);
+    return NULL;
+}
+
+// parses items until a keyword that closes the enclosing construct
+static struct node *parse_list(struct sparser *p, int *ok) {
+    struct node *head = NULL, **tail = &head;
+
+    while (*ok && p->pos < p->count) {
+        struct stoken *t = &p->toks[p->pos];
+        struct node *n = NULL;
+
+        if (t->kw == KW_NONE) {
+            p->pos++;
+            n = new_node(NODE_CMD);
+            if (!n) { *ok = 0; break; }
+            if (!parse_command(t->text, &n->cmd)) {
+                free(n);
+                *ok = 0;
+                break;
+            }
+            n->text = strdup(t->text);
+            if (!n->text) {
+                free_script(n);
+                *ok = 0;
+                break;
+            }
+        } else if (t->kw == KW_IF) {
+            p->pos++;
+            n = parse_if_tail(p, ok);
+        } else if (t->kw == KW_WHILE) {
+            p->pos++;
+            n = new_node(NODE_WHILE);
+            if (!n) { *ok = 0; break; }
+            n->cond = parse_list(p, ok);
+            if (!*ok || !present(p, n->cond) || !expect_kw(p, KW_DO)) {
+                *ok = 0;
+            } else {
+                n->body = parse_list(p, ok);
+                if (!*ok || !present(p, n->body) || !expect_kw(p, KW_DONE)) *ok = 0;
+            }
+            if (!*ok) { free_script(n); n = NULL; }
+        } else if (t->kw == KW_FOR) {
+            p->pos++;
+            n = parse_for(p, t->text, ok);
+        } else {
+            break; // then/elif/else/fi/do/done end this list
+        }
+
+        if (!n) break;
+        *tail = n;
+        tail = &n->next;
+    }
+
+    if (!*ok) {
+        free_script(head);
+        return NULL;
+    }
+    return head;
+}
+
+int parse_script(const char *text, struct node **out) {
+    if (text == NULL || out == NULL) {
+        return 0;
+    }
+    *out = NULL;
+
+    struct sparser p = {0};
+    const char *seg = text;
+    for (const char *c = text; ; c++) {
+        // a ';' or newline inside $(...) belongs to the substitution
+        const char *end = skip_subst(c);
+        if (!end) {
+            free_stokens(&p);
+            return -1; // unclosed, the rest comes on the next lines
+        }
+        if (end != c) {
+            c = end - 1;
+            continue;
+        }
+        if (*c == ';' || *c == '\n' || *c == '\0') {
+            if (!tokenize_segment(&p, seg, c - seg)) {
+                free_stokens(&p);
+                return 0;
+            }
+            if (*c == '\0') break;
+            seg = c + 1;
+        }
+    }
+
+    int ok = 1;
+    struct node *head = parse_list(&p, &ok);
+    if (ok && p.pos < p.count) {
+        ok = 0; // stray closing keyword at top level
+    }
+    int incomplete = p.incomplete;
+    free_stokens(&p);
+
+    if (!ok) {
+        free_script(head);
+        return incomplete ? -1 : 0;
+    }
+    *out = head;
+    return 1;
+}
+
+void free_script(struct node *n) {
+    while (n) {
+        struct node *next = n->next;
+        if (n->type == NODE_CMD) {
+            free_command(&n->cmd);
+        }
+        free(n->text);
+        free_script(n->cond);
+        free_script(n->body);
+        free_script(n->alt);
+        free(n->var);
+        if (n->words) {
+            for (int i = 0; n->words[i] != NULL; i++) free(n->words[i]);
+            free(n->words);
+        }
+        free(n);
+        n = next;
+    }
+}
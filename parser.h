@@ -1,13 +1,27 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+// kinds of redirection: "n<f", "n>f", "n>>f", "n>&m" / "n<&m", "n>&-" / "n<&-",
+// and "n>&NAME" / "n<&NAME" to coprocess NAME's stdin / stdout (coproc.h)
+typedef enum { REDIR_IN, REDIR_OUT, REDIR_APPEND, REDIR_DUP, REDIR_CLOSE, REDIR_COPROC } redir_kind_t;
+
+// one redirection, applied in order by redir_apply()
+struct redir {
+    int fd;                 // fd being redirected (0 for '<', 1 for '>')
+    redir_kind_t kind;
+    char *path;             // IN/OUT/APPEND: file to open, COPROC: its name
+    int target;             // DUP: fd to copy onto fd, COPROC: 1 writes to it, 0 reads from it
+};
+
 // structure to represent a complete command with redirections and pipes
 struct command {
     char **argv;                                        // left side command + args (NULL-terminated)
-    char *infile, *outfile, *errfile;                  // left side redirections
+    struct redir *redirs;                               // left side redirections
+    int nredirs;
     int has_pipe;
     char **pipe_argv;                                  // right side command + args (NULL-terminated)
-    char *pipe_infile, *pipe_outfile, *pipe_errfile;   // right side redirections
+    struct redir *pipe_redirs;                          // right side redirections
+    int pipe_nredirs;
     int background;
 };
 
@@ -19,11 +33,56 @@ int parse_command(const char *line, struct command *cmd);
 // Frees memory allocated for a command structure
 void free_command(struct command *cmd);
 
+// expands $NAME, ${NAME}, $? and $$ in one word from the variable store and
+// replaces $(cmd) / `cmd` with the command's output (subst.c)
+// returns a malloc'd string (NULL on allocation failure or a failed substitution)
+char *expand_word(const char *word);
+
+// expands every word of src ($VAR and $(cmd), then globbing) into a new
+// NULL-terminated array in *dst; the output of a substitution is split into
+// words on blanks (except in NAME=value), words that expand to nothing are dropped
+// returns 1 on success, 0 on failure
+int expand_words(char **src, char ***dst);
+
+// fills dst with a copy of src where every word and redirection file name is
+// expanded (file names are not globbed); words that expand to nothing are dropped
+// returns 1 on success, 0 on failure; caller must call free_command(dst)
+int expand_command(const struct command *src, struct command *dst);
+
+// deep copy of src without any expansion (e.g. to keep a queued job around)
+// returns 1 on success, 0 on failure; caller must call free_command(dst)
+int copy_command(const struct command *src, struct command *dst);
+
 // Helper functions for parsing special tokens
-int handle_input_redirection(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side);
-int handle_output_redirection(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side);
-int handle_error_redirection(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side);
+int handle_redirection(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side);
 int handle_pipe(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side);
 int handle_background(struct command *cmd, char *curr_tok, char **saveptr, const char *delims, int parsing_side);
 
+// node kinds for a parsed script (one or more commands, loops, conditionals)
+typedef enum { NODE_CMD, NODE_IF, NODE_WHILE, NODE_FOR } node_type_t;
+
+// a script is a linked list of nodes, each one parsed exactly once
+// loop bodies are re-executed from this tree instead of being re-parsed
+struct node {
+    node_type_t type;
+    struct command cmd;     // NODE_CMD: the parsed simple command
+    char *text;             // NODE_CMD: source text, shown in the job table
+    struct node *cond;      // IF/WHILE: condition list
+    struct node *body;      // IF: then list, WHILE/FOR: loop body
+    struct node *alt;       // IF: else list (elif is a nested IF)
+    char *var;              // FOR: loop variable name
+    char **words;           // FOR: word list (NULL-terminated)
+    struct node *next;      // next node in the same list
+};
+
+// parses a script made of ';' or newline separated commands, including
+// for/while/if compound commands
+// returns 1 on success, 0 on a syntax error, -1 if the input is incomplete
+// (e.g. a 'do' without its 'done') and more lines should be appended
+// caller must call free_script() on success
+int parse_script(const char *text, struct node **out);
+
+// Frees a whole node list returned by parse_script()
+void free_script(struct node *n);
+
 #endif // PARSER_H
\ No newline at end of file
@@ -0,0 +1,529 @@
+#define _GNU_SOURCE
+#include "pathexp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define CACHE_BUCKETS 256
+#define DENTS_BUF (256 * 1024)
+
+// raw record returned by getdents64
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// one directory's entries, read once and shared by every pattern that needs it
+struct listing {
+    char *dir;
+    char *names;            // all entry names, NUL separated
+    size_t names_len;
+    size_t *offs;           // start of each name in names
+    unsigned char *types;   // d_type of each entry
+    int count;
+    struct listing *next;
+};
+
+static struct listing *cache[CACHE_BUCKETS];
+
+/* ---------- matching ---------- */
+
+// a pattern component is compiled once and then run against every entry
+enum { PT_CHAR, PT_ANY, PT_STAR, PT_SET };
+
+struct pat_tok {
+    unsigned char kind;
+    unsigned char c;        // PT_CHAR
+    uint32_t set[8];        // PT_SET: one bit per byte value
+};
+
+struct cpat {
+    struct pat_tok *toks;
+    int count;
+    int explicit_dot;       // pattern starts with '.', so hidden names may match
+    const char *prefix;     // literal text before the first wildcard,
+    size_t prefix_len;      // checked with memcmp before running the matcher
+    const char *suffix;     // literal text after the last '*'
+    size_t suffix_len;
+    int one_star;           // prefix '*' suffix and nothing else: the checks above are the whole match
+};
+
+// parses the bracket expression starting after '[' into set
+// returns the pointer past ']' or NULL if the bracket is never closed
+static const char *parse_bracket(const char *p, uint32_t set[8]) {
+    int negate = 0;
+    if (*p == '!' || *p == '^') {
+        negate = 1;
+        p++;
+    }
+    memset(set, 0, sizeof(uint32_t) * 8);
+    const char *start = p;
+    while (*p && (*p != ']' || p == start)) {
+        unsigned lo = (unsigned char)*p, hi = lo;
+        if (p[1] == '-' && p[2] && p[2] != ']') {
+            hi = (unsigned char)p[2];
+            p += 3;
+        } else {
+            p++;
+        }
+        for (unsigned c = lo; c <= hi; c++) set[c >> 5] |= 1u << (c & 31);
+    }
+    if (*p != ']') return NULL;
+    if (negate) {
+        for (int i = 0; i < 8; i++) set[i] = ~set[i];
+    }
+    return p + 1;
+}
+
+static int compile_pattern(const char *pattern, struct cpat *cp) {
+    memset(cp, 0, sizeof(*cp));
+    cp->toks = malloc(sizeof(struct pat_tok) * (strlen(pattern) + 1));
+    if (!cp->toks) return -1;
+    cp->explicit_dot = pattern[0] == '.';
+
+    int last_star = -1;
+    const char *p = pattern;
+    while (*p) {
+        struct pat_tok *t = &cp->toks[cp->count];
+        if (*p == '*') {
+            t->kind = PT_STAR;
+            last_star = cp->count;
+            while (*p == '*') p++; // "**" inside a component is one star
+        } else if (*p == '?') {
+            t->kind = PT_ANY;
+            p++;
+        } else if (*p == '[' && parse_bracket(p + 1, t->set)) {
+            t->kind = PT_SET;
+            p = parse_bracket(p + 1, t->set);
+        } else {
+            t->kind = PT_CHAR; // includes an unclosed '['
+            t->c = *p++;
+        }
+        cp->count++;
+    }
+
+    // literal prefix/suffix, only valid as raw text if every token in them is PT_CHAR
+    int i = 0;
+    while (i < cp->count && cp->toks[i].kind == PT_CHAR) i++;
+    cp->prefix = pattern;
+    cp->prefix_len = i;
+    if (last_star >= 0) {
+        int plain = 1;
+        for (int j = last_star + 1; j < cp->count; j++) {
+            if (cp->toks[j].kind != PT_CHAR) plain = 0;
+        }
+        if (plain) {
+            cp->suffix_len = cp->count - last_star - 1;
+            cp->suffix = pattern + strlen(pattern) - cp->suffix_len;
+            cp->one_star = last_star == i;
+        }
+    }
+    return 0;
+}
+
+static int tok_matches(const struct pat_tok *t, unsigned char c) {
+    if (t->kind == PT_ANY) return 1;
+    if (t->kind == PT_CHAR) return t->c == c;
+    return (t->set[c >> 5] >> (c & 31)) & 1;
+}
+
+// iterative matcher, backtracking only to the most recent '*'; len is strlen(name)
+static int run_pattern(const struct cpat *cp, const char *name, size_t len) {
+    if (name[0] == '.' && !cp->explicit_dot) return 0; // hidden files need an explicit dot
+
+    if (len < cp->prefix_len + cp->suffix_len) return 0;
+    if (memcmp(name, cp->prefix, cp->prefix_len) != 0) return 0;
+    if (cp->suffix_len && memcmp(name + len - cp->suffix_len, cp->suffix, cp->suffix_len) != 0) return 0;
+    if (cp->one_star) return 1; // "*.log", "file_01*": nothing left to check
+
+    const struct pat_tok *t = cp->toks, *end = cp->toks + cp->count;
+    const struct pat_tok *star_t = NULL;
+    const unsigned char *s = (const unsigned char *)name, *star_s = NULL;
+    while (*s) {
+        if (t < end && t->kind == PT_STAR) {
+            star_t = ++t;
+            star_s = s;
+            continue;
+        }
+        if (t < end && tok_matches(t, *s)) {
+            t++;
+            s++;
+            continue;
+        }
+        if (!star_t) return 0;
+        t = star_t;
+        s = ++star_s;
+    }
+    while (t < end && t->kind == PT_STAR) t++;
+    return t == end;
+}
+
+int pathexp_match(const char *pattern, const char *name) {
+    struct cpat cp;
+    if (compile_pattern(pattern, &cp) < 0) return 0;
+    int m = run_pattern(&cp, name, strlen(name));
+    free(cp.toks);
+    return m;
+}
+
+int pathexp_has_glob(const char *word) {
+    for (const char *p = word; *p; p++) {
+        if (*p == '*' || *p == '?') return 1;
+        if (*p == '[') {
+            uint32_t set[8];
+            if (parse_bracket(p + 1, set)) return 1;
+        }
+    }
+    return 0;
+}
+
+/* ---------- directory listing cache ---------- */
+
+static unsigned hash_dir(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h % CACHE_BUCKETS;
+}
+
+static void free_listing(struct listing *l) {
+    free(l->dir);
+    free(l->names);
+    free(l->offs);
+    free(l->types);
+    free(l);
+}
+
+void pathexp_cache_clear(void) {
+    for (int i = 0; i < CACHE_BUCKETS; i++) {
+        while (cache[i]) {
+            struct listing *next = cache[i]->next;
+            free_listing(cache[i]);
+            cache[i] = next;
+        }
+    }
+}
+
+// reads every entry of dir with getdents64 into one listing
+// unreadable directories get an empty listing so we don't retry them
+static struct listing *read_dir(const char *dir) {
+    struct listing *l = calloc(1, sizeof(*l));
+    if (!l) return NULL;
+    l->dir = strdup(dir);
+    if (!l->dir) {
+        free(l);
+        return NULL;
+    }
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return l;
+
+    char *buf = malloc(DENTS_BUF);
+    size_t names_cap = 0;
+    int cap = 0;
+    long n;
+    while (buf && (n = syscall(SYS_getdents64, fd, buf, DENTS_BUF)) > 0) {
+        for (long pos = 0; pos < n; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + pos);
+            pos += d->d_reclen;
+            const char *name = d->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+            size_t len = strlen(name) + 1;
+            if (l->names_len + len > names_cap) {
+                names_cap = names_cap ? names_cap * 2 : 4096;
+                while (names_cap < l->names_len + len) names_cap *= 2;
+                char *grown = realloc(l->names, names_cap);
+                if (!grown) goto out;
+                l->names = grown;
+            }
+            if (l->count >= cap) {
+                cap = cap ? cap * 2 : 64;
+                size_t *offs = realloc(l->offs, sizeof(size_t) * cap);
+                if (!offs) goto out;
+                l->offs = offs;
+                unsigned char *types = realloc(l->types, cap);
+                if (!types) goto out;
+                l->types = types;
+            }
+            memcpy(l->names + l->names_len, name, len);
+            l->offs[l->count] = l->names_len;
+            l->types[l->count] = d->d_type;
+            l->names_len += len;
+            l->count++;
+        }
+    }
+out:
+    free(buf);
+    close(fd);
+    return l;
+}
+
+// names are stored back to back, so the next one's start gives the length
+static size_t name_len(const struct listing *l, int i) {
+    size_t end = i + 1 < l->count ? l->offs[i + 1] : l->names_len;
+    return end - l->offs[i] - 1;
+}
+
+static struct listing *get_listing(const char *dir) {
+    unsigned h = hash_dir(dir);
+    for (struct listing *l = cache[h]; l; l = l->next) {
+        if (strcmp(l->dir, dir) == 0) return l;
+    }
+    struct listing *l = read_dir(dir);
+    if (!l) return NULL;
+    l->next = cache[h];
+    cache[h] = l;
+    return l;
+}
+
+/* ---------- expansion ---------- */
+
+struct results {
+    char **v;
+    int count;
+    int cap;
+    int failed;
+};
+
+// joins up to three pieces into a new string
+static char *join(const char *base, const char *name, const char *tail) {
+    size_t a = strlen(base), b = strlen(name), c = strlen(tail);
+    char *s = malloc(a + b + c + 1);
+    if (!s) return NULL;
+    memcpy(s, base, a);
+    memcpy(s + a, name, b);
+    memcpy(s + a + b, tail, c + 1);
+    return s;
+}
+
+static void add_result(struct results *r, const char *base, const char *name, const char *tail) {
+    if (r->failed) return;
+    if (r->count >= r->cap) {
+        int cap = r->cap ? r->cap * 2 : 16;
+        char **grown = realloc(r->v, sizeof(char *) * cap);
+        if (!grown) {
+            r->failed = 1;
+            return;
+        }
+        r->v = grown;
+        r->cap = cap;
+    }
+    char *s = join(base, name, tail);
+    if (!s) {
+        r->failed = 1;
+        return;
+    }
+    r->v[r->count++] = s;
+}
+
+// is entry i of l a directory? follow_links=0 for '**' so we never loop
+static int entry_is_dir(struct listing *l, int i, const char *base, int follow_links) {
+    unsigned char t = l->types[i];
+    if (t == DT_DIR) return 1;
+    if (t != DT_UNKNOWN && (t != DT_LNK || !follow_links)) return 0;
+
+    char *path = join(base, l->names + l->offs[i], "");
+    if (!path) return 0;
+    struct stat st;
+    int rc = follow_links ? stat(path, &st) : lstat(path, &st);
+    free(path);
+    return rc == 0 && S_ISDIR(st.st_mode);
+}
+
+// matches comps[i..] below base ("" for the current directory, otherwise ending in '/')
+static void expand_from(const char *base, char **comps, int ncomps, int i, int want_dir, struct results *r) {
+    const char *comp = comps[i];
+    int last = (i == ncomps - 1);
+    const char *tail = (last && want_dir) ? "/" : "";
+
+    if (strcmp(comp, "**") == 0) {
+        // zero directories, then every non-hidden subdirectory (keeping '**')
+        if (!last) expand_from(base, comps, ncomps, i + 1, want_dir, r);
+        struct listing *l = get_listing(*base ? base : ".");
+        if (!l) {
+            r->failed = 1;
+            return;
+        }
+        for (int e = 0; e < l->count && !r->failed; e++) {
+            const char *name = l->names + l->offs[e];
+            if (name[0] == '.') continue;
+            int is_dir = entry_is_dir(l, e, base, 0);
+            if (last && (!want_dir || is_dir)) add_result(r, base, name, tail);
+            if (is_dir) {
+                char *sub = join(base, name, "/");
+                if (!sub) {
+                    r->failed = 1;
+                    return;
+                }
+                expand_from(sub, comps, ncomps, i, want_dir, r);
+                free(sub);
+            }
+        }
+        return;
+    }
+
+    if (!pathexp_has_glob(comp)) {
+        // literal component: no listing needed, just check it exists
+        char *path = join(base, comp, "");
+        if (!path) {
+            r->failed = 1;
+            return;
+        }
+        struct stat st;
+        if (last) {
+            if (lstat(path, &st) == 0 && (!want_dir || (stat(path, &st) == 0 && S_ISDIR(st.st_mode)))) {
+                add_result(r, path, tail, "");
+            }
+        } else if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            char *sub = join(path, "/", "");
+            if (!sub) {
+                r->failed = 1;
+            } else {
+                expand_from(sub, comps, ncomps, i + 1, want_dir, r);
+                free(sub);
+            }
+        }
+        free(path);
+        return;
+    }
+
+    struct listing *l = get_listing(*base ? base : ".");
+    struct cpat cp;
+    if (!l || compile_pattern(comp, &cp) < 0) {
+        r->failed = 1;
+        return;
+    }
+    for (int e = 0; e < l->count && !r->failed; e++) {
+        const char *name = l->names + l->offs[e];
+        if (!run_pattern(&cp, name, name_len(l, e))) continue;
+        if (last) {
+            if (!want_dir || entry_is_dir(l, e, base, 1)) add_result(r, base, name, tail);
+        } else if (entry_is_dir(l, e, base, 1)) {
+            char *sub = join(base, name, "/");
+            if (!sub) {
+                r->failed = 1;
+                break;
+            }
+            expand_from(sub, comps, ncomps, i + 1, want_dir, r);
+            free(sub);
+        }
+    }
+    free(cp.toks);
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+struct sort_key {
+    uint64_t key;           // 8 bytes after the shared prefix, big-endian, 0-padded
+    char *s;
+};
+
+// sorts v into strcmp order: each word is read once for the 8 bytes after
+// the prefix all of them share, those keys are radix sorted, and only runs
+// of equal keys are compared with strcmp
+static void sort_words(char **v, int n) {
+    struct sort_key *k = n > 1 ? malloc(sizeof(*k) * n * 2) : NULL;
+    if (!k) {
+        if (n > 1) qsort(v, n, sizeof(char *), cmp_str);
+        return;
+    }
+    size_t lcp = strlen(v[0]);
+    for (int i = 1; i < n && lcp > 0; i++) {
+        size_t j = 0;
+        while (j < lcp && v[i][j] == v[0][j]) j++;
+        lcp = j;
+    }
+    for (int i = 0; i < n; i++) {
+        const unsigned char *p = (const unsigned char *)v[i] + lcp;
+        uint64_t key = 0;
+        int j = 0;
+        for (; j < 8 && p[j]; j++) key = key << 8 | p[j];
+        k[i].key = key << (8 * (8 - j));
+        k[i].s = v[i];
+    }
+
+    // least significant byte first, skipping bytes that are the same everywhere
+    struct sort_key *from = k, *to = k + n;
+    for (int shift = 0; shift < 64; shift += 8) {
+        int count[257] = {0};
+        for (int i = 0; i < n; i++) count[((from[i].key >> shift) & 0xff) + 1]++;
+        if (count[((from[0].key >> shift) & 0xff) + 1] == n) continue;
+        for (int b = 0; b < 256; b++) count[b + 1] += count[b];
+        for (int i = 0; i < n; i++) to[count[(from[i].key >> shift) & 0xff]++] = from[i];
+        struct sort_key *t = from;
+        from = to;
+        to = t;
+    }
+
+    for (int i = 0; i < n; i++) v[i] = from[i].s;
+    // equal keys: the words agree on 8 more bytes, the rest decides
+    for (int i = 0; i < n;) {
+        int j = i + 1;
+        while (j < n && from[j].key == from[i].key) j++;
+        if (j - i > 1) qsort(v + i, j - i, sizeof(char *), cmp_str);
+        i = j;
+    }
+    free(k);
+}
+
+int pathexp_expand(const char *pattern, char ***out, int *count) {
+    char *copy = strdup(pattern);
+    if (!copy) return -1;
+
+    // split into components, remembering a leading '/' and a trailing '/'
+    size_t len = strlen(copy);
+    int want_dir = len > 0 && copy[len - 1] == '/';
+    const char *base = copy[0] == '/' ? "/" : "";
+    char *comps[256];
+    int ncomps = 0;
+    char *saveptr = NULL;
+    for (char *c = strtok_r(copy, "/", &saveptr); c; c = strtok_r(NULL, "/", &saveptr)) {
+        if (ncomps == (int)(sizeof(comps) / sizeof(comps[0]))) {
+            free(copy);
+            return 0; // absurdly deep, leave the word alone
+        }
+        comps[ncomps++] = c;
+    }
+
+    struct results r = {0};
+    if (ncomps > 0) expand_from(base, comps, ncomps, 0, want_dir, &r);
+    free(copy);
+
+    if (r.failed) {
+        for (int i = 0; i < r.count; i++) free(r.v[i]);
+        free(r.v);
+        return -1;
+    }
+    if (r.count == 0) {
+        free(r.v);
+        return 0;
+    }
+    sort_words(r.v, r.count);
+
+    char **grown = realloc(*out, sizeof(char *) * (*count + r.count + 1));
+    if (!grown) {
+        for (int i = 0; i < r.count; i++) free(r.v[i]);
+        free(r.v);
+        return -1;
+    }
+    memcpy(grown + *count, r.v, sizeof(char *) * r.count);
+    *count += r.count;
+    grown[*count] = NULL;
+    *out = grown;
+    free(r.v);
+    return r.count;
+}
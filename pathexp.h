@@ -0,0 +1,25 @@
+#ifndef PATHEXP_H
+#define PATHEXP_H
+
+// pathname expansion (globbing) for command words
+// supports '*', '?', '[...]' (with '!'/'^' negation and ranges) and '**' as a
+// whole path component for any number of directories
+// directories are read in bulk with getdents64 and kept in a listing cache,
+// so several patterns over the same directory only scan it once
+
+// 1 if word contains glob syntax
+int pathexp_has_glob(const char *word);
+
+// appends the sorted matches of pattern to *out (a NULL-terminated array of
+// *count malloc'd strings, grown as needed)
+// returns the number of matches (0 = no match, nothing appended), -1 on error
+int pathexp_expand(const char *pattern, char ***out, int *count);
+
+// drops every cached directory listing; call once the command that
+// needed them has been expanded
+void pathexp_cache_clear(void);
+
+// 1 if name matches a single-component pattern (no '/')
+int pathexp_match(const char *pattern, const char *name);
+
+#endif /* PATHEXP_H */
@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+#include "redir.h"
+#include "coproc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// saved copies go above the low fds that users redirect by number
+#define SAVE_FD_MIN 10
+
+static int save_fd(struct redir_saved *save, int fd) {
+    for (int i = 0; i < save->count; i++) {
+        if (save->entries[i].fd == fd) return 0; // first save wins
+    }
+    void *grown = realloc(save->entries, sizeof(save->entries[0]) * (save->count + 1));
+    if (!grown) return -1;
+    save->entries = grown;
+
+    int copy = fcntl(fd, F_DUPFD_CLOEXEC, SAVE_FD_MIN);
+    if (copy < 0 && errno != EBADF) return -1;
+    save->entries[save->count].fd = fd;
+    save->entries[save->count].copy = copy; // -1: fd was closed, close it again on restore
+    save->count++;
+    return 0;
+}
+
+// makes src appear as fd (without close-on-exec), consuming src if it was opened for us
+static int move_fd(int src, int fd, int owned) {
+    if (src == fd) {
+        // open() handed us the very fd we wanted, just let it survive exec
+        return fcntl(fd, F_SETFD, 0);
+    }
+    if (dup3(src, fd, 0) < 0) {
+        int err = errno;
+        if (owned) close(src);
+        errno = err;
+        return -1;
+    }
+    if (owned) close(src);
+    return 0;
+}
+
+int redir_apply(const struct redir *redirs, int count, struct redir_saved *save) {
+    if (save) {
+        // anything the builtin already buffered belongs to the old stdout
+        fflush(stdout);
+        fflush(stderr);
+    }
+
+    for (int i = 0; i < count; i++) {
+        const struct redir *r = &redirs[i];
+        if (save && save_fd(save, r->fd) < 0) return -1;
+
+        switch (r->kind) {
+        case REDIR_IN:
+        case REDIR_OUT:
+        case REDIR_APPEND: {
+            int flags = O_CLOEXEC;
+            if (r->kind == REDIR_IN) {
+                flags |= O_RDONLY;
+            } else if (r->kind == REDIR_OUT) {
+                flags |= O_WRONLY | O_CREAT | O_TRUNC;
+            } else {
+                flags |= O_WRONLY | O_CREAT | O_APPEND;
+            }
+            int src = open(r->path, flags, 0644); // 0644 same as S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH
+            if (src < 0) return -1;
+            if (move_fd(src, r->fd, 1) < 0) return -1;
+            break;
+        }
+        case REDIR_DUP:
+            if (r->target == r->fd) {
+                // "1>&1" is a no-op but the fd still has to exist
+                if (fcntl(r->fd, F_GETFD) < 0) return -1;
+                break;
+            }
+            if (move_fd(r->target, r->fd, 0) < 0) return -1;
+            break;
+        case REDIR_CLOSE:
+            close(r->fd);
+            break;
+        case REDIR_COPROC: {
+            int src = coproc_fd(r->path, r->target);
+            if (src < 0) {
+                // say which name, a bare EBADF wouldn't
+                if (r->target && coproc_fd(r->path, 0) >= 0) {
+                    fprintf(stderr, "%s: coprocess input is closed\n", r->path);
+                } else {
+                    fprintf(stderr, "%s: no such coprocess\n", r->path);
+                }
+                errno = EBADF;
+                return -1;
+            }
+            if (move_fd(src, r->fd, 0) < 0) return -1;
+            break;
+        }
+        }
+    }
+    return 0;
+}
+
+void redir_restore(struct redir_saved *save) {
+    if (!save) return;
+    fflush(stdout);
+    fflush(stderr);
+
+    // undo in reverse, a later redirection may have landed on an earlier saved copy
+    for (int i = save->count - 1; i >= 0; i--) {
+        int fd = save->entries[i].fd;
+        int copy = save->entries[i].copy;
+        if (copy < 0) {
+            close(fd);
+        } else {
+            dup3(copy, fd, 0);
+            close(copy);
+        }
+    }
+    free(save->entries);
+    save->entries = NULL;
+    save->count = 0;
+}
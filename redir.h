@@ -0,0 +1,27 @@
+#ifndef REDIR_H
+#define REDIR_H
+
+#include "parser.h"
+
+// original fds saved by redir_apply() so an in-process builtin can undo them
+struct redir_saved {
+    struct {
+        int fd;     // fd that was redirected
+        int copy;   // close-on-exec copy of the original, -1 if fd was closed
+    } *entries;
+    int count;
+};
+
+// applies redirections in order (so "> f 2>&1" opens f once and copies it)
+// every fd is opened O_CLOEXEC and moved into place with dup3(), so only the
+// redirected fds survive an exec
+// in a child before exec pass save == NULL, around a builtin pass a zeroed
+// struct redir_saved and call redir_restore() afterwards
+// returns 0 on success, -1 on failure with errno set (a missing coprocess is
+// also reported on stderr by name)
+int redir_apply(const struct redir *redirs, int count, struct redir_saved *save);
+
+// puts back every fd saved by redir_apply() (also after a failed apply)
+void redir_restore(struct redir_saved *save);
+
+#endif /* REDIR_H */
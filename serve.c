@@ -0,0 +1,574 @@
+#define _GNU_SOURCE
+#include "serve.h"
+#include "parser.h"
+#include "eval.h"
+#include "exec.h"
+#include "jobs.h"
+#include "zygote.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <dirent.h>
+
+// a connection stops getting output from its requests while this much is
+// still waiting to be sent to it, and resumes at half
+#define OUT_HIGH (1 << 20)
+#define READ_CHUNK (64 * 1024)
+
+struct buf {
+    char *data;
+    size_t len;     // bytes in data
+    size_t off;     // bytes of them already sent / parsed
+    size_t cap;
+};
+
+// what an epoll event is about
+enum watch_kind { W_LISTEN, W_CONN, W_STDOUT, W_STDERR, W_PIDFD };
+struct watch {
+    enum watch_kind kind;
+    void *owner;    // struct conn or struct request
+};
+
+struct conn {
+    int fd;                 // -1 once the client is gone
+    struct watch w;
+    struct buf in, out;
+    int running;            // requests not yet finished
+    int paused;             // their output is held back (OUT_HIGH)
+    int in_done;            // the client shut down its side, no more requests
+    int want_out;           // EPOLLOUT is on
+    struct conn *next_dead;
+};
+
+struct request {
+    uint32_t id;
+    struct conn *conn;
+    pid_t pid;
+    int pidfd;              // -1 once reaped
+    int out_fd, err_fd;     // -1 at EOF
+    struct watch w_out, w_err, w_pid;
+    int status;
+    struct rusage ru;
+    int done;               // exit frame sent, freed after this batch of events
+    struct request *next;
+};
+
+static int ep = -1;
+static struct request *requests = NULL;
+
+// freed between epoll batches: a batch may still hold events for them
+static struct request *dead_requests = NULL;
+static struct conn *dead_conns = NULL;
+static volatile sig_atomic_t stopping = 0;
+
+static void on_stop(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+/* ---------- buffers and frames ---------- */
+
+static int buf_add(struct buf *b, const void *data, size_t n) {
+    if (b->off > 0 && b->off == b->len) b->off = b->len = 0;
+    if (b->len + n > b->cap) {
+        // shift out what is done before growing
+        if (b->off > 0) {
+            memmove(b->data, b->data + b->off, b->len - b->off);
+            b->len -= b->off;
+            b->off = 0;
+        }
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + n) cap *= 2;
+        if (cap != b->cap) {
+            char *grown = realloc(b->data, cap);
+            if (!grown) return -1;
+            b->data = grown;
+            b->cap = cap;
+        }
+    }
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+    return 0;
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void put_u64(unsigned char *p, uint64_t v) {
+    put_u32(p, v >> 32);
+    put_u32(p + 4, (uint32_t)v);
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void watch_set(int fd, struct watch *w, uint32_t events) {
+    struct epoll_event ev = { .events = events, .data.ptr = w };
+    epoll_ctl(ep, EPOLL_CTL_MOD, fd, &ev);
+}
+
+static int watch_add(int fd, struct watch *w, uint32_t events) {
+    struct epoll_event ev = { .events = events, .data.ptr = w };
+    return epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void conn_close(struct conn *c);
+static void conn_pause(struct conn *c, int paused);
+
+static void conn_watch(struct conn *c) {
+    watch_set(c->fd, &c->w, (c->in_done ? 0 : EPOLLIN) | (c->want_out ? EPOLLOUT : 0));
+}
+
+// sends what it can without blocking, waits for EPOLLOUT for the rest
+static void conn_flush(struct conn *c) {
+    while (c->fd >= 0 && c->out.off < c->out.len) {
+        ssize_t n = send(c->fd, c->out.data + c->out.off, c->out.len - c->out.off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) conn_close(c);
+            break;
+        }
+        c->out.off += n;
+    }
+    if (c->fd < 0) return;
+    size_t pending = c->out.len - c->out.off;
+    if (pending == 0 && c->in_done && c->running == 0) {
+        conn_close(c); // half-closed and everything answered
+        return;
+    }
+    if ((pending > 0) != c->want_out) {
+        c->want_out = pending > 0;
+        conn_watch(c);
+    }
+    if (c->paused && pending < OUT_HIGH / 2) conn_pause(c, 0);
+}
+
+static void send_frame(struct conn *c, char type, uint32_t id, const void *payload, size_t len) {
+    if (c->fd < 0) return; // the client left, the output goes nowhere
+    unsigned char h[SERVE_HEADER];
+    h[0] = (unsigned char)type;
+    put_u32(h + 1, id);
+    put_u32(h + 5, (uint32_t)len);
+    if (buf_add(&c->out, h, sizeof(h)) < 0 || buf_add(&c->out, payload, len) < 0) {
+        conn_close(c);
+        return;
+    }
+    conn_flush(c);
+    if (c->fd >= 0 && !c->paused && c->out.len - c->out.off > OUT_HIGH) conn_pause(c, 1);
+}
+
+/* ---------- requests ---------- */
+
+// stops (or resumes) reading the output of every request of c
+static void conn_pause(struct conn *c, int paused) {
+    c->paused = paused;
+    for (struct request *r = requests; r; r = r->next) {
+        if (r->conn != c) continue;
+        if (r->out_fd >= 0) watch_set(r->out_fd, &r->w_out, paused ? 0 : EPOLLIN);
+        if (r->err_fd >= 0) watch_set(r->err_fd, &r->w_err, paused ? 0 : EPOLLIN);
+    }
+}
+
+// the subshell: parse and evaluate like at the prompt, status as exit code
+static void run_child(const char *script, int out, int err) {
+    // its own session: the commands it runs get process groups of their own,
+    // and the session is how hangup_session() still finds all of them
+    setsid();
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+
+    int null = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (null < 0 || dup2(null, STDIN_FILENO) < 0 || dup2(out, STDOUT_FILENO) < 0 ||
+        dup2(err, STDERR_FILENO) < 0) {
+        _exit(126);
+    }
+    // the listening socket, the clients and the other requests' pipes
+    exec_close_cloexec_fds();
+    // the helper's children would be ours and not the subshell's, and the
+    // server's jobs aren't the request's
+    zygote_stop();
+    jobs_init();
+
+    struct node *tree;
+    int rc = parse_script(script, &tree);
+    if (rc <= 0) {
+        fprintf(stderr, "yash: syntax error\n");
+        _exit(2);
+    }
+    int status = eval_script(tree);
+    fflush(stdout);
+    fflush(stderr);
+    _exit(status & 0xff);
+}
+
+static void request_start(struct conn *c, uint32_t id, const char *script, size_t len) {
+    char *text = strndup(script, len);
+    int out[2] = { -1, -1 }, err[2] = { -1, -1 };
+    struct request *r = calloc(1, sizeof(*r));
+    if (!text || !r || pipe2(out, O_CLOEXEC) < 0 || pipe2(err, O_CLOEXEC) < 0) goto fail;
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) goto fail;
+    if (pid == 0) run_child(text, out[1], err[1]);
+
+    free(text);
+    text = NULL;
+    close(out[1]);
+    close(err[1]);
+    r->id = id;
+    r->conn = c;
+    r->pid = pid;
+    r->out_fd = out[0];
+    r->err_fd = err[0];
+    r->pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    fcntl(r->out_fd, F_SETFL, O_NONBLOCK);
+    fcntl(r->err_fd, F_SETFL, O_NONBLOCK);
+    r->w_out = (struct watch){ W_STDOUT, r };
+    r->w_err = (struct watch){ W_STDERR, r };
+    r->w_pid = (struct watch){ W_PIDFD, r };
+    uint32_t events = c->paused ? 0 : EPOLLIN;
+    if (r->pidfd < 0 || watch_add(r->pidfd, &r->w_pid, EPOLLIN) < 0 ||
+        watch_add(r->out_fd, &r->w_out, events) < 0 || watch_add(r->err_fd, &r->w_err, events) < 0) {
+        // without a pidfd there is nothing to tell us it ended
+        kill(-pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        if (r->pidfd >= 0) close(r->pidfd);
+        close(r->out_fd);
+        close(r->err_fd);
+        free(r);
+        static const char msg[] = "yash: could not track the request\n";
+        send_frame(c, SERVE_STDERR, id, msg, sizeof(msg) - 1);
+        unsigned char x[28] = {0};
+        put_u32(x, 126);
+        send_frame(c, SERVE_EXIT, id, x, sizeof(x));
+        return;
+    }
+    r->next = requests;
+    requests = r;
+    c->running++;
+    return;
+
+fail:
+    free(text);
+    free(r);
+    for (int i = 0; i < 2; i++) {
+        if (out[i] >= 0) close(out[i]);
+        if (err[i] >= 0) close(err[i]);
+    }
+    static const char msg[] = "yash: could not start the request\n";
+    send_frame(c, SERVE_STDERR, id, msg, sizeof(msg) - 1);
+    unsigned char x[28] = {0};
+    put_u32(x, 126);
+    send_frame(c, SERVE_EXIT, id, x, sizeof(x));
+}
+
+static void conn_free(struct conn *c) {
+    c->next_dead = dead_conns;
+    dead_conns = c;
+}
+
+static void free_dead(void) {
+    while (dead_conns) {
+        struct conn *c = dead_conns;
+        dead_conns = c->next_dead;
+        free(c->in.data);
+        free(c->out.data);
+        free(c);
+    }
+    while (dead_requests) {
+        struct request *r = dead_requests;
+        dead_requests = r->next;
+        free(r);
+    }
+}
+
+// the exit frame goes out once the process is reaped and both pipes hit EOF,
+// so it always comes after the last of the output
+static void request_maybe_done(struct request *r) {
+    if (r->done || r->pidfd >= 0 || r->out_fd >= 0 || r->err_fd >= 0) return;
+    r->done = 1;
+
+    struct conn *c = r->conn;
+    unsigned char x[28];
+    int status = 0;
+    if (WIFEXITED(r->status)) {
+        status = WEXITSTATUS(r->status);
+    } else if (WIFSIGNALED(r->status)) {
+        status = 128 + WTERMSIG(r->status);
+    }
+    put_u32(x, (uint32_t)status);
+    put_u64(x + 4, (uint64_t)r->ru.ru_utime.tv_sec * 1000000 + r->ru.ru_utime.tv_usec);
+    put_u64(x + 12, (uint64_t)r->ru.ru_stime.tv_sec * 1000000 + r->ru.ru_stime.tv_usec);
+    put_u64(x + 20, (uint64_t)r->ru.ru_maxrss);
+    send_frame(c, SERVE_EXIT, r->id, x, sizeof(x));
+
+    for (struct request **pp = &requests; *pp; pp = &(*pp)->next) {
+        if (*pp == r) {
+            *pp = r->next;
+            break;
+        }
+    }
+    r->next = dead_requests;
+    dead_requests = r;
+    if (--c->running == 0) {
+        if (c->fd < 0) {
+            conn_free(c);
+        } else if (c->in_done) {
+            conn_flush(c); // closes it once the last frames are out
+        }
+    }
+}
+
+static void close_output(int *fd) {
+    epoll_ctl(ep, EPOLL_CTL_DEL, *fd, NULL);
+    close(*fd);
+    *fd = -1;
+}
+
+static void request_output(struct request *r, int which) {
+    int *fd = which == W_STDOUT ? &r->out_fd : &r->err_fd;
+    if (*fd < 0) return; // closed by conn_close earlier in this batch
+    char chunk[READ_CHUNK];
+    // one read per event, so a chatty request can't starve the others
+    ssize_t n = read(*fd, chunk, sizeof(chunk));
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (n > 0) {
+        send_frame(r->conn, which == W_STDOUT ? SERVE_STDOUT : SERVE_STDERR, r->id, chunk, n);
+        return;
+    }
+    close_output(fd);
+    request_maybe_done(r);
+}
+
+static void request_reap(struct request *r) {
+    if (r->pidfd < 0) return;
+    // wait4 rather than waitid(P_PIDFD): it hands back the rusage too
+    if (wait4(r->pid, &r->status, WNOHANG, &r->ru) == 0) return;
+    epoll_ctl(ep, EPOLL_CTL_DEL, r->pidfd, NULL);
+    close(r->pidfd);
+    r->pidfd = -1;
+    request_maybe_done(r);
+}
+
+// SIGHUP (and SIGCONT, for stopped ones) to every process group in a
+// request's session, found by the session field of /proc/PID/stat
+static void hangup_session(pid_t sid) {
+    DIR *d = opendir("/proc");
+    if (!d) {
+        kill(-sid, SIGHUP);
+        kill(-sid, SIGCONT);
+        return;
+    }
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] < '0' || e->d_name[0] > '9') continue;
+        char path[300], stat[512];
+        snprintf(path, sizeof(path), "/proc/%s/stat", e->d_name);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        ssize_t n = read(fd, stat, sizeof(stat) - 1);
+        close(fd);
+        if (n <= 0) continue;
+        stat[n] = '\0';
+        // the command name may hold anything, the fields after it don't
+        char *end = strrchr(stat, ')');
+        int pgrp, session;
+        if (!end || sscanf(end + 1, " %*c %*d %d %d", &pgrp, &session) != 2) continue;
+        if (session != sid) continue;
+        kill(-pgrp, SIGHUP);
+        kill(-pgrp, SIGCONT);
+    }
+    closedir(d);
+}
+
+/* ---------- connections ---------- */
+
+// the client is gone: its requests get SIGHUP and lose their output pipes
+// (so what they started gets SIGPIPE at its next write), and the connection
+// is freed with the last of them
+static void conn_close(struct conn *c) {
+    if (c->fd < 0) return;
+    epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    c->paused = 0;
+    // with requests left, the last of them to finish frees it (request_maybe_done)
+    if (c->running == 0) {
+        conn_free(c);
+        return;
+    }
+    struct request *next;
+    for (struct request *r = requests; r; r = next) {
+        next = r->next;
+        if (r->conn != c) continue;
+        hangup_session(r->pid);
+        if (r->out_fd >= 0) close_output(&r->out_fd);
+        if (r->err_fd >= 0) close_output(&r->err_fd);
+        request_maybe_done(r); // if it was already reaped
+    }
+}
+
+static void conn_read(struct conn *c) {
+    char chunk[READ_CHUNK];
+    ssize_t n = read(c->fd, chunk, sizeof(chunk));
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (n == 0) {
+        // shutdown(SHUT_WR): the answers still go out, then we close
+        c->in_done = 1;
+        conn_watch(c);
+        conn_flush(c);
+        return;
+    }
+    if (n < 0 || buf_add(&c->in, chunk, n) < 0) {
+        conn_close(c);
+        return;
+    }
+
+    // every complete frame in the buffer
+    while (c->fd >= 0 && c->in.len - c->in.off >= SERVE_HEADER) {
+        const unsigned char *h = (const unsigned char *)c->in.data + c->in.off;
+        uint32_t id = get_u32(h + 1), len = get_u32(h + 5);
+        if (h[0] != SERVE_REQUEST || len > SERVE_MAX_REQUEST) {
+            conn_close(c);
+            return;
+        }
+        if (c->in.len - c->in.off < SERVE_HEADER + (size_t)len) break;
+        request_start(c, id, (const char *)h + SERVE_HEADER, len);
+        c->in.off += SERVE_HEADER + len;
+    }
+}
+
+static void accept_all(int lfd) {
+    while (1) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) perror("yash: accept");
+            return;
+        }
+        struct conn *c = calloc(1, sizeof(*c));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->w = (struct watch){ W_CONN, c };
+        if (watch_add(fd, &c->w, EPOLLIN) < 0) {
+            close(fd);
+            free(c);
+        }
+    }
+}
+
+/* ---------- main loop ---------- */
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "yash: %s: socket path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // a socket left behind by a server that died; anything else stays put
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+        fprintf(stderr, "yash: %s: %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve_main(const char *path) {
+    // three fds per request in flight, so take every fd we are allowed
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    int lfd = listen_on(path);
+    if (lfd < 0) return 1;
+    ep = epoll_create1(EPOLL_CLOEXEC);
+    struct watch wl = { W_LISTEN, NULL };
+    if (ep < 0 || watch_add(lfd, &wl, EPOLLIN) < 0) {
+        perror("yash: epoll");
+        close(lfd);
+        unlink(path);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    struct epoll_event events[64];
+    while (!stopping) {
+        int n = epoll_wait(ep, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("yash: epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            struct watch *w = events[i].data.ptr;
+            uint32_t ev = events[i].events;
+            switch (w->kind) {
+            case W_LISTEN:
+                accept_all(lfd);
+                break;
+            case W_CONN: {
+                struct conn *c = w->owner;
+                if (c->fd < 0) break; // closed earlier in this batch
+                if (ev & (EPOLLHUP | EPOLLERR)) {
+                    conn_close(c);
+                    break;
+                }
+                if (ev & EPOLLOUT) conn_flush(c);
+                if (c->fd >= 0 && (ev & EPOLLIN)) conn_read(c);
+                break;
+            }
+            case W_STDOUT:
+            case W_STDERR:
+                request_output(w->owner, w->kind);
+                break;
+            case W_PIDFD:
+                request_reap(w->owner);
+                break;
+            }
+        }
+        free_dead();
+    }
+
+    // shutting down: whatever still runs gets a hangup, like at logout
+    for (struct request *r = requests; r; r = r->next) hangup_session(r->pid);
+    close(lfd);
+    unlink(path);
+    return 0;
+}
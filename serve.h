@@ -0,0 +1,35 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdint.h>
+
+// headless server mode: yash --serve PATH
+// listens on a Unix stream socket and runs every request in its own subshell,
+// one epoll loop for all clients and their in-flight requests
+//
+// both ways the stream is made of frames:
+//   type (1 byte)  id (4 bytes)  length (4 bytes)  payload (length bytes)
+// integers are big-endian; id is picked by the client and echoed back, so a
+// connection can have many requests running at once
+//
+//   'R' client -> server   payload: a command line or script, like typed at the prompt
+//   'O' server -> client   a chunk of the request's stdout
+//   'E' server -> client   a chunk of its stderr
+//   'X' server -> client   it finished, after its last 'O'/'E'; payload:
+//                          status (4), user cpu us (8), system cpu us (8), max rss KB (8)
+//
+// a request gets /dev/null as stdin; closing the connection sends SIGHUP to
+// the requests it still has running
+
+#define SERVE_REQUEST 'R'
+#define SERVE_STDOUT 'O'
+#define SERVE_STDERR 'E'
+#define SERVE_EXIT 'X'
+
+#define SERVE_HEADER 9
+#define SERVE_MAX_REQUEST (1 << 20)  // longer requests close the connection
+
+// runs the server until SIGINT or SIGTERM; returns the shell's exit status
+int serve_main(const char *path);
+
+#endif /* SERVE_H */
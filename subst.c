@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+#include "subst.h"
+#include "parser.h"
+#include "eval.h"
+#include "redir.h"
+#include "builtins.h"
+#include "jobs.h"
+#include "vars.h"
+#include "zygote.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* ---------- output buffer ---------- */
+
+struct outbuf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+static int outbuf_reserve(struct outbuf *b, size_t room) {
+    if (b->cap - b->len > room) return 0;
+    // doubling keeps a big output at O(n) copying overall
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap - b->len <= room) cap *= 2;
+    char *grown = realloc(b->data, cap);
+    if (!grown) return -1;
+    b->data = grown;
+    b->cap = cap;
+    return 0;
+}
+
+// everything up to EOF on fd
+static int read_all(int fd, struct outbuf *b) {
+    while (1) {
+        if (outbuf_reserve(b, 4096) < 0) return -1;
+        ssize_t n = read(fd, b->data + b->len, b->cap - b->len - 1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return 0;
+        b->len += n;
+    }
+}
+
+/* ---------- running the script ---------- */
+
+// 1 if every command is a builtin that only writes output, so running the
+// script in the shell itself looks the same as running it in a subshell
+// (no for: its loop variable would stay set)
+static int pure_builtins(const struct node *n) {
+    for (; n; n = n->next) {
+        if (n->type == NODE_FOR) return 0;
+        if (n->type == NODE_CMD) {
+            const struct command *c = &n->cmd;
+            if (c->has_pipe || c->background) return 0;
+            // a name that comes from an expansion is only known later
+            if (strpbrk(c->argv[0], "$`*?[")) return 0;
+            const struct builtin *b = builtin_find(c->argv[0]);
+            if (!b || !(b->flags & BUILTIN_PURE)) return 0;
+        }
+        if (!pure_builtins(n->cond) || !pure_builtins(n->body) || !pure_builtins(n->alt)) return 0;
+    }
+    return 1;
+}
+
+// runs tree with stdout on a memfd; no fork, no pipe round trips
+static int capture_in_shell(struct node *tree, struct outbuf *b) {
+    int fd = memfd_create("yash-subst", MFD_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct redir r = { STDOUT_FILENO, REDIR_DUP, NULL, fd };
+    struct redir_saved saved = {0};
+    int rc = -1;
+    if (redir_apply(&r, 1, &saved) == 0) {
+        eval_nested(tree);
+        rc = 0;
+    }
+    redir_restore(&saved); // flushes what the builtins printed into the memfd
+    clearerr(stdout);
+
+    struct stat st;
+    if (rc == 0 && fstat(fd, &st) == 0 && outbuf_reserve(b, st.st_size) == 0) {
+        ssize_t n = st.st_size ? pread(fd, b->data, st.st_size, 0) : 0;
+        if (n < 0) {
+            rc = -1;
+        } else {
+            b->len = n;
+        }
+    } else {
+        rc = -1;
+    }
+    close(fd);
+    return rc;
+}
+
+// runs tree in a forked subshell and reads its stdout through a pipe
+static int capture_in_child(struct node *tree, struct outbuf *b) {
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) return -1;
+    // a bigger pipe means fewer wakeups for large outputs (best effort)
+    fcntl(p[1], F_SETPIPE_SZ, 1 << 20);
+
+    // or the child would print what we still have buffered a second time
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(p[0]);
+        close(p[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        if (dup2(p[1], STDOUT_FILENO) < 0) _exit(1);
+        // the helper's children would be the shell's and not ours to wait
+        // for, and the shell's jobs aren't ours to start or report
+        zygote_stop();
+        jobs_init();
+        int status = eval_script(tree);
+        fflush(stdout);
+        _exit(status & 0xff);
+    }
+
+    close(p[1]);
+    int rc = read_all(p[0], b);
+    close(p[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    if (WIFEXITED(status)) {
+        vars_set_last_status(WEXITSTATUS(status));
+    } else if (WIFSIGNALED(status)) {
+        vars_set_last_status(128 + WTERMSIG(status));
+    }
+    return rc;
+}
+
+char *subst_run(const char *script, size_t len) {
+    char *text = strndup(script, len);
+    if (!text) return NULL;
+    struct node *tree;
+    int rc = parse_script(text, &tree);
+    if (rc <= 0) {
+        fprintf(stderr, "yash: bad command substitution: %s\n", text);
+        free(text);
+        return NULL;
+    }
+    free(text);
+
+    struct outbuf b = {0};
+    if (outbuf_reserve(&b, 0) < 0) {
+        free_script(tree);
+        return NULL;
+    }
+    if (pure_builtins(tree)) {
+        rc = capture_in_shell(tree, &b);
+    } else {
+        rc = capture_in_child(tree, &b);
+    }
+    free_script(tree);
+    if (rc < 0) {
+        free(b.data);
+        return NULL;
+    }
+
+    while (b.len > 0 && b.data[b.len - 1] == '\n') b.len--;
+    b.data[b.len] = '\0';
+    return b.data;
+}
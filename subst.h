@@ -0,0 +1,16 @@
+#ifndef SUBST_H
+#define SUBST_H
+
+#include <stddef.h>
+
+// command substitution: $(script) and `script`
+// the script's stdout is read back through a pipe from a forked subshell, or,
+// when it only uses builtins that change nothing (echo, pwd, ...), captured
+// in a memfd while it runs in the shell itself
+
+// runs the len bytes of script and returns what it wrote with the trailing
+// newlines removed (malloc'd, "" for no output), or NULL if it couldn't be
+// parsed or run; $? in the rest of the command is the script's exit status
+char *subst_run(const char *script, size_t len);
+
+#endif /* SUBST_H */
@@ -0,0 +1,659 @@
+// end-to-end job control checks: drives yash under a pseudo-terminal the way a
+// user would (typed lines, ctrl-c / ctrl-z through the tty) and times how long
+// each fg / bg / stop / resume takes to hand the terminal back
+// before the cycles, one pass over the other features (compound commands, wait,
+// loaded builtins, bench, cgroups, substitution, copy builtins, cache,
+// coprocesses, pinning) and a --serve client that disconnects mid-request
+// usage: pty_harness [-n cycles] [-t max_ms] [-v] [yash [args...]]
+// exits 1 if a check fails or a median latency is over max_ms
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define CTRL_C "\x03"
+#define CTRL_D "\x04"
+#define CTRL_Z "\x1a"
+
+#define PROMPT "# "
+#define TIMEOUT_MS 5000 // anything slower than this counts as a hang
+
+static int master = -1;
+static pid_t shell_pid = -1;
+static int verbose = 0;
+static int failures = 0;
+
+// everything the shell printed so far; expect() consumes it from mark onwards
+static char *out = NULL;
+static size_t out_len = 0, out_cap = 0, mark = 0;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void fail(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fputs("FAIL: ", stdout);
+    vprintf(fmt, ap);
+    putchar('\n');
+    va_end(ap);
+    // show what the shell printed since the last match
+    printf("---- unmatched output ----\n%.*s\n--------------------------\n",
+           (int)(out_len - mark), out + mark);
+    failures++;
+}
+
+static void append(const char *buf, size_t n) {
+    if (out_len + n + 1 > out_cap) {
+        size_t cap = out_cap ? out_cap : 4096;
+        while (cap < out_len + n + 1) cap *= 2;
+        char *grown = realloc(out, cap);
+        if (!grown) {
+            perror("realloc");
+            exit(2);
+        }
+        out = grown;
+        out_cap = cap;
+    }
+    memcpy(out + out_len, buf, n);
+    out_len += n;
+    out[out_len] = '\0';
+    if (verbose) fwrite(buf, 1, n, stderr);
+}
+
+// reads whatever the shell has written, waiting up to ms; 0 on EOF
+static int pump(int ms) {
+    struct pollfd pfd = { master, POLLIN, 0 };
+    int rc = poll(&pfd, 1, ms);
+    if (rc <= 0) return rc < 0 && errno != EINTR ? 0 : 1;
+    char buf[4096];
+    ssize_t n = read(master, buf, sizeof(buf));
+    if (n <= 0) return 0; // EIO once the shell has exited and closed the slave
+    append(buf, (size_t)n);
+    return 1;
+}
+
+// waits until s shows up in the output, then moves the mark past it
+// returns 1 if it did, 0 on timeout or if the shell went away
+static int expect(const char *s) {
+    double deadline = now_ms() + TIMEOUT_MS;
+    while (1) {
+        char *hit = out ? strstr(out + mark, s) : NULL;
+        if (hit) {
+            mark = (size_t)(hit - out) + strlen(s);
+            return 1;
+        }
+        double left = deadline - now_ms();
+        if (left <= 0 || !pump((int)left)) return 0;
+    }
+}
+
+// the prompt starts a line, or follows the tty's "^C" / "^Z" echo directly
+// (the shell doesn't print a newline after a job is interrupted or stopped)
+static char *find_prompt(void) {
+    for (char *p = out ? strstr(out + mark, PROMPT) : NULL; p; p = strstr(p + 1, PROMPT)) {
+        if (p == out || p[-1] == '\n' ||
+            (p - out >= 2 && p[-2] == '^' && (p[-1] == 'C' || p[-1] == 'Z'))) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static int expect_prompt(void) {
+    double deadline = now_ms() + TIMEOUT_MS;
+    while (1) {
+        char *hit = find_prompt();
+        if (hit) {
+            mark = (size_t)(hit - out) + strlen(PROMPT);
+            return 1;
+        }
+        double left = deadline - now_ms();
+        if (left <= 0 || !pump((int)left)) return 0;
+    }
+}
+
+static void send_keys(const char *s) {
+    size_t n = strlen(s);
+    while (n > 0) {
+        ssize_t w = write(master, s, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            perror("write");
+            exit(2);
+        }
+        s += w;
+        n -= (size_t)w;
+    }
+}
+
+// types a line and waits for the next prompt, returns ms from enter to prompt or -1
+static double run_line(const char *line) {
+    send_keys(line);
+    double t0 = now_ms();
+    send_keys("\n");
+    if (!expect_prompt()) {
+        fail("no prompt after '%s'", line);
+        return -1;
+    }
+    return now_ms() - t0;
+}
+
+// whether the output from start up to the mark contains want
+static int output_has(size_t start, const char *want) {
+    // temporarily cut the buffer at the mark so strstr stays in range
+    char saved = out[mark];
+    out[mark] = '\0';
+    int ok = strstr(out + start, want) != NULL;
+    out[mark] = saved;
+    return ok;
+}
+
+// runs a line and checks the output between it and the next prompt contains want
+static int check_line(const char *line, const char *want) {
+    size_t start = mark;
+    if (run_line(line) < 0) return 0;
+    int ok = output_has(start, want);
+    if (!ok) {
+        mark = start;
+        fail("'%s' did not print '%s'", line, want);
+    }
+    return ok;
+}
+
+static void check_status(const char *want) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "\n%s\r\n", want);
+    check_line("echo $?", buf);
+}
+
+/* ---------- latency samples ---------- */
+
+struct series {
+    const char *name;
+    double *ms;
+    int n;
+};
+
+static void add_sample(struct series *s, double ms) {
+    if (ms >= 0) s->ms[s->n++] = ms;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// prints the series and returns 1 if its median is over max_ms
+static int report(struct series *s, double max_ms) {
+    if (s->n == 0) {
+        printf("%-8s no samples\n", s->name);
+        return 1;
+    }
+    qsort(s->ms, s->n, sizeof(double), cmp_double);
+    double p50 = s->ms[s->n / 2];
+    int over = max_ms > 0 && p50 > max_ms;
+    printf("%-8s n=%-3d min %7.2f ms  p50 %7.2f ms  max %7.2f ms%s\n", s->name, s->n,
+           s->ms[0], p50, s->ms[s->n - 1], over ? "  <-- over limit" : "");
+    return over;
+}
+
+/* ---------- scenarios ---------- */
+
+static void start_shell(char **argv) {
+    struct winsize ws = { 24, 120, 0, 0 };
+    shell_pid = forkpty(&master, NULL, NULL, &ws);
+    if (shell_pid < 0) {
+        perror("forkpty");
+        exit(2);
+    }
+    if (shell_pid == 0) {
+        // dumb terminal: no bracketed paste or other escapes in the output
+        setenv("TERM", "dumb", 1);
+        setenv("INPUTRC", "/dev/null", 1);
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    if (!expect_prompt()) {
+        fail("shell never showed a prompt");
+        exit(1);
+    }
+}
+
+// the basics: commands run, ctrl-c at the prompt doesn't kill the shell
+static void smoke(void) {
+    check_line("echo hello", "\nhello\r\n");
+    check_status("0");
+    check_line("false", "");
+    check_status("1");
+
+    send_keys(CTRL_C);
+    check_line("echo still here", "\nstill here\r\n");
+}
+
+// ctrl-c reaches the foreground job only
+static void interrupt_cycle(struct series *intr) {
+    send_keys("sleep 30\n");
+    expect("sleep 30\r\n");
+    usleep(50000); // let it actually start and own the tty
+    double t0 = now_ms();
+    send_keys(CTRL_C);
+    if (!expect_prompt()) {
+        fail("ctrl-c did not bring the prompt back");
+        return;
+    }
+    add_sample(intr, now_ms() - t0);
+    check_status("130");
+}
+
+// sleep: ctrl-z, bg, fg, ctrl-c with the job table checked at every step
+static void stop_bg_fg_cycle(struct series *stop, struct series *bg, struct series *fg) {
+    send_keys("sleep 30\n");
+    expect("sleep 30\r\n");
+    usleep(50000);
+
+    double t0 = now_ms();
+    send_keys(CTRL_Z);
+    if (!expect_prompt()) {
+        fail("ctrl-z did not bring the prompt back");
+        return;
+    }
+    add_sample(stop, now_ms() - t0);
+    check_line("jobs", "+  Stopped  sleep 30");
+
+    add_sample(bg, run_line("bg"));
+    check_line("jobs", "+  Running  sleep 30");
+
+    // fg only returns once the job stops again, so time until the shell is
+    // blocked in it: a ctrl-z sent then must come back as Stopped
+    t0 = now_ms();
+    send_keys("fg\n");
+    if (!expect("sleep 30\r\n")) {
+        fail("fg did not name the job");
+        return;
+    }
+    add_sample(fg, now_ms() - t0);
+    usleep(20000);
+    send_keys(CTRL_C);
+    if (!expect_prompt()) {
+        fail("ctrl-c after fg did not bring the prompt back");
+        return;
+    }
+    check_status("130");
+    check_line("jobs", "\r\n\r\n"); // empty table: just the trailing blank line
+}
+
+// cat reading the tty: resume must hand the terminal back for input to work
+static void resume_cycle(struct series *resume, int i) {
+    char ping[32], want[80];
+    snprintf(ping, sizeof(ping), "ping%d", i);
+
+    send_keys("cat\n");
+    expect("cat\r\n");
+    // keys typed before readline puts the tty back in cooked mode aren't echoed
+    usleep(50000);
+    send_keys(ping);
+    send_keys("\n");
+    snprintf(want, sizeof(want), "%s\r\n%s\r\n", ping, ping); // tty echo, then cat
+    if (!expect(want)) {
+        fail("cat did not echo %s", ping);
+        return;
+    }
+
+    send_keys(CTRL_Z);
+    if (!expect_prompt()) {
+        fail("ctrl-z did not stop cat");
+        return;
+    }
+    check_line("jobs", "+  Stopped  cat");
+
+    // resume latency: from typing fg to cat answering on the terminal again
+    snprintf(ping, sizeof(ping), "pong%d", i);
+    snprintf(want, sizeof(want), "%s\r\n%s\r\n", ping, ping);
+    double t0 = now_ms();
+    send_keys("fg\n");
+    if (!expect("cat\r\n")) {
+        fail("fg did not name cat");
+        return;
+    }
+    send_keys(ping);
+    send_keys("\n");
+    if (!expect(want)) {
+        fail("resumed cat did not echo %s", ping);
+        return;
+    }
+    add_sample(resume, now_ms() - t0);
+
+    send_keys(CTRL_D);
+    if (!expect_prompt()) {
+        fail("cat did not exit on ctrl-d");
+        return;
+    }
+    check_status("0");
+}
+
+/* ---------- the other features, once per run ---------- */
+
+static void write_file(const char *dir, const char *name, const char *text, int mode) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if (fd < 0 || write(fd, text, strlen(text)) < 0) {
+        perror(path);
+        exit(2);
+    }
+    close(fd);
+}
+
+// one line per feature where that's enough, with dir as scratch space
+static void features(const char *dir) {
+    char line[1024];
+    size_t start;
+    write_file(dir, "k.json", "{\"name\": \"yash\", \"n\": 3}\n", 0644);
+    write_file(dir, "job.sh", "#!/bin/sh\necho run >> \"$(dirname \"$0\")/log\"\necho out\n", 0755);
+    write_file(dir, "die.sh", "#!/bin/sh\nkill -9 $$\n", 0755);
+
+    // $? after a compound command
+    check_line("if false; then :; fi; echo $?", "\n0\r\n");
+    check_line("while false; do :; done; echo $?", "\n0\r\n");
+
+    // wait: an unknown last id is 127
+    check_line("wait %99", "no such job");
+    check_status("127");
+
+    // wait on a stopped job refuses instead of blocking forever
+    send_keys("sleep 30\n");
+    expect("sleep 30\r\n");
+    usleep(50000);
+    send_keys(CTRL_Z);
+    if (!expect_prompt()) {
+        fail("ctrl-z did not stop sleep");
+    } else {
+        int id = 0;
+        start = mark;
+        run_line("jobs");
+        char *p = strstr(out + start, "[");
+        if (!p || sscanf(p, "[%d]", &id) != 1) {
+            fail("jobs did not list the stopped sleep");
+        } else {
+            snprintf(line, sizeof(line), "wait %%%d", id);
+            check_line(line, "is stopped");
+            check_status("148");
+            snprintf(line, sizeof(line), "kill -9 %%%d", id);
+            run_line(line);
+        }
+    }
+
+    // a loaded builtin in the shell, in a pipeline and in the background
+    check_line("enable -f ./examples/jsonget.so jsonget", "");
+    snprintf(line, sizeof(line), "jsonget name %s/k.json", dir);
+    check_line(line, "\nyash\r\n");
+    snprintf(line, sizeof(line), "cat %s/k.json | jsonget name", dir);
+    check_line(line, "\nyash\r\n");
+    snprintf(line, sizeof(line), "jsonget n %s/k.json > %s/n.txt &", dir, dir);
+    run_line(line);
+    check_line("wait", "");
+    snprintf(line, sizeof(line), "cat %s/n.txt", dir);
+    check_line(line, "\n3\r\n");
+
+    // bench, and a child killed from outside reported as 128+9
+    check_line("bench -n 3 true", "p50");
+    check_status("0");
+    snprintf(line, sizeof(line), "bench -n 1 %s/die.sh", dir);
+    check_line(line, "status 137");
+
+    // command substitution, both forms
+    check_line("echo a$(echo b)c `echo d`", "\nabc d\r\n");
+
+    // cp, and tee -a appending rather than overwriting
+    snprintf(line, sizeof(line), "cp %s/k.json %s/k2.json", dir, dir);
+    check_line(line, "");
+    snprintf(line, sizeof(line), "cat %s/k2.json | tee -a %s/t.txt > /dev/null", dir, dir);
+    run_line(line);
+    run_line(line);
+    snprintf(line, sizeof(line), "cat %s/t.txt", dir);
+    check_line(line, "\"n\": 3}\r\n{\"name\"");
+
+    // cache: the second run is replayed, the script doesn't run again
+    snprintf(line, sizeof(line), "cache %s/job.sh", dir);
+    check_line(line, "\nout\r\n");
+    check_line(line, "\nout\r\n");
+    snprintf(line, sizeof(line), "cat %s/log", dir);
+    start = mark;
+    if (check_line(line, "\nrun\r\n") && output_has(start, "run\r\nrun")) {
+        fail("cache ran a cached command again");
+    }
+
+    // a coprocess, one line there and back
+    check_line("coproc C cat", "");
+    check_line("coproc send C hello there", "");
+    check_line("coproc recv C", "\nhello there\r\n");
+    check_line("coproc close C", "");
+    check_line("echo x >&NOPE", "NOPE: no such coprocess");
+    check_status("1");
+
+    // pinning must leave the pipeline working, whatever the CPUs
+    check_line("set -o pin=on", "");
+    check_line("echo piped | cat", "\npiped\r\n");
+    // a shell stage would pass its one CPU to everything it runs
+    check_line("set -o pin=verbose", "");
+    check_line("sh -c 'echo sub' | cat", "not pinning sh | cat");
+    check_line("set -o pin=off", "");
+
+    // cgroups only where the machine gives us a cgroup v2 subtree
+    start = mark;
+    run_line("set -o cgroups=on");
+    if (output_has(start, "cgroups:")) {
+        printf("cgroups: not available here, skipped\n");
+    } else {
+        check_line("cat /proc/self/cgroup", "/job.");
+        check_line("set -o cgroups=off", "");
+    }
+}
+
+// frames of the --serve protocol: type, id, length (big-endian), payload
+static void send_request(int fd, unsigned id, const char *text) {
+    unsigned char h[9];
+    size_t len = strlen(text);
+    h[0] = 'R';
+    for (int i = 0; i < 4; i++) {
+        h[1 + i] = (unsigned char)(id >> (24 - 8 * i));
+        h[5 + i] = (unsigned char)(len >> (24 - 8 * i));
+    }
+    if (write(fd, h, sizeof(h)) < 0 || write(fd, text, len) < 0) perror("serve: write");
+}
+
+static int serve_connect(const char *path) {
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", path);
+    double deadline = now_ms() + TIMEOUT_MS;
+    while (now_ms() < deadline) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0) return fd;
+        if (fd >= 0) close(fd);
+        usleep(10000); // not listening yet
+    }
+    return -1;
+}
+
+// a client hanging up while its request still has a job running must not
+// take the server down, and the next client gets its answer
+static void serve_check(char **shell_argv, const char *dir) {
+    char sock[512];
+    snprintf(sock, sizeof(sock), "%s/serve.sock", dir);
+    char *argv[32];
+    int n = 0;
+    for (int i = 0; shell_argv[i] && n < 29; i++) argv[n++] = shell_argv[i];
+    argv[n++] = "--serve";
+    argv[n++] = sock;
+    argv[n] = NULL;
+
+    pid_t server = fork();
+    if (server == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    int fd = serve_connect(sock);
+    if (fd < 0) {
+        fail("serve: could not connect to %s", sock);
+        kill(server, SIGKILL);
+        waitpid(server, NULL, 0);
+        return;
+    }
+    send_request(fd, 1, "sleep 2 &");
+    usleep(100000);
+    close(fd);
+    usleep(200000);
+
+    int status;
+    if (waitpid(server, &status, WNOHANG) == server) {
+        fail("serve: server died after a client hung up (status %d)",
+             WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+        return;
+    }
+
+    char reply[4096];
+    size_t got = 0;
+    fd = serve_connect(sock);
+    if (fd >= 0) {
+        send_request(fd, 2, "echo alive");
+        shutdown(fd, SHUT_WR);
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        ssize_t r = 1;
+        while (r > 0 && got < sizeof(reply) && poll(&pfd, 1, TIMEOUT_MS) > 0) {
+            r = read(fd, reply + got, sizeof(reply) - got);
+            if (r > 0) got += (size_t)r;
+        }
+        close(fd);
+    }
+    // an 'O' frame with the output, then the 'X' frame with status 0
+    static const unsigned char want_out[] = { 'O', 0, 0, 0, 2, 0, 0, 0, 6, 'a', 'l', 'i', 'v', 'e', '\n' };
+    static const unsigned char want_exit[] = { 'X', 0, 0, 0, 2, 0, 0, 0, 28, 0, 0, 0, 0 };
+    if (!memmem(reply, got, want_out, sizeof(want_out)) || !memmem(reply, got, want_exit, sizeof(want_exit))) {
+        fail("serve: no answer to \"echo alive\" after the first client left (%zu bytes back)", got);
+    }
+
+    kill(server, SIGTERM);
+    double deadline = now_ms() + TIMEOUT_MS;
+    pid_t w;
+    while ((w = waitpid(server, &status, WNOHANG)) == 0 && now_ms() < deadline) usleep(10000);
+    if (w != server) {
+        fail("serve: server did not exit on SIGTERM");
+        kill(server, SIGKILL);
+        waitpid(server, &status, 0);
+    } else if (!WIFEXITED(status)) {
+        fail("serve: server died with signal %d", WTERMSIG(status));
+    }
+}
+
+static void stop_shell(void) {
+    send_keys(CTRL_D);
+    double deadline = now_ms() + TIMEOUT_MS;
+    int status = 0;
+    pid_t w;
+    while ((w = waitpid(shell_pid, &status, WNOHANG)) == 0 && now_ms() < deadline) {
+        pump(50);
+    }
+    if (w != shell_pid) {
+        fail("shell did not exit on ctrl-d");
+        kill(shell_pid, SIGKILL);
+        waitpid(shell_pid, &status, 0);
+    } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fail("shell exited with status %d", WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+    }
+    close(master);
+}
+
+int main(int argc, char **argv) {
+    int cycles = 10;
+    double max_ms = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "+n:t:v")) != -1) {
+        switch (opt) {
+        case 'n': cycles = atoi(optarg); break;
+        case 't': max_ms = atof(optarg); break;
+        case 'v': verbose = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-n cycles] [-t max_ms] [-v] [yash [args...]]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (cycles < 1) cycles = 1;
+
+    char *default_argv[] = { "./yash", NULL };
+    char **shell_argv = optind < argc ? argv + optind : default_argv;
+
+    signal(SIGPIPE, SIG_IGN);
+    char dir[] = "/tmp/yash_harness_XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 2;
+    }
+    char cache[64];
+    snprintf(cache, sizeof(cache), "%s/cache", dir);
+    setenv("XDG_CACHE_HOME", cache, 1); // cache entries stay in the scratch dir
+    start_shell(shell_argv);
+
+    struct series all[] = {
+        { "intr",   calloc(cycles, sizeof(double)), 0 },
+        { "stop",   calloc(cycles, sizeof(double)), 0 },
+        { "bg",     calloc(cycles, sizeof(double)), 0 },
+        { "fg",     calloc(cycles, sizeof(double)), 0 },
+        { "resume", calloc(cycles, sizeof(double)), 0 },
+    };
+    int nseries = sizeof(all) / sizeof(all[0]);
+
+    smoke();
+    features(dir);
+    serve_check(shell_argv, dir);
+    for (int i = 0; i < cycles && failures == 0; i++) {
+        interrupt_cycle(&all[0]);
+        stop_bg_fg_cycle(&all[1], &all[2], &all[3]);
+        resume_cycle(&all[4], i);
+    }
+    char line[128];
+    snprintf(line, sizeof(line), "rm -r %s", dir);
+    check_line(line, "");
+    stop_shell();
+
+    printf("%s: %d cycle(s)", shell_argv[0], cycles);
+    for (int i = 1; shell_argv[i]; i++) printf(" %s", shell_argv[i]);
+    putchar('\n');
+    int slow = 0;
+    for (int i = 0; i < nseries; i++) {
+        slow += report(&all[i], max_ms);
+        free(all[i].ms);
+    }
+    free(out);
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    if (slow) {
+        printf("latency over %g ms in %d series\n", max_ms, slow);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include "topo.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <dirent.h>
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#define MAX_CACHE_INDEX 10
+
+struct cpu {
+    int core;   // lowest of its SMT siblings, the same for every thread of a core
+    int l2, l3; // lowest CPU sharing that cache with it, -1 if sysfs doesn't say
+    int node;
+};
+
+static pin_mode_t mode = PIN_OFF;
+static struct cpu info[CPU_SETSIZE];
+static int usable[CPU_SETSIZE];     // online CPUs we may run on, ascending
+static int nusable = -1;            // -1 until the layout is read
+static unsigned placed = 0;         // pipelines placed so far, for taking turns
+
+void topo_set_mode(pin_mode_t m) {
+    mode = m;
+}
+
+pin_mode_t topo_get_mode(void) {
+    return mode;
+}
+
+// reads a sysfs CPU list ("0-3,8,10-11") into set; returns its lowest CPU, -1 if unreadable
+static int read_list(const char *path, cpu_set_t *set) {
+    FILE *f = fopen(path, "re");
+    if (!f) return -1;
+    char line[4096];
+    int first = -1;
+    if (set) CPU_ZERO(set);
+    if (fgets(line, sizeof(line), f)) {
+        char *save = NULL;
+        for (char *r = strtok_r(line, ",\n", &save); r; r = strtok_r(NULL, ",\n", &save)) {
+            int lo, hi;
+            int n = sscanf(r, "%d-%d", &lo, &hi);
+            if (n < 1) continue;
+            if (n == 1) hi = lo;
+            if (first < 0 || lo < first) first = lo;
+            for (int c = lo; set && c <= hi && c < CPU_SETSIZE; c++) CPU_SET(c, set);
+        }
+    }
+    fclose(f);
+    return first;
+}
+
+static int read_int(const char *path) {
+    FILE *f = fopen(path, "re");
+    int v = -1;
+    if (f) {
+        if (fscanf(f, "%d", &v) != 1) v = -1;
+        fclose(f);
+    }
+    return v;
+}
+
+static void read_cpu(int c) {
+    char path[256], type[32];
+    struct cpu *p = &info[c];
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/thread_siblings_list", c);
+    p->core = read_list(path, NULL);
+    if (p->core < 0) p->core = c;
+
+    p->l2 = p->l3 = -1;
+    for (int i = 0; i < MAX_CACHE_INDEX; i++) {
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/level", c, i);
+        int level = read_int(path);
+        if (level < 0) break;
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/type", c, i);
+        FILE *f = fopen(path, "re");
+        type[0] = '\0';
+        if (f) {
+            if (!fgets(type, sizeof(type), f)) type[0] = '\0';
+            fclose(f);
+        }
+        if (strncmp(type, "Instruction", 11) == 0) continue;
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/shared_cpu_list", c, i);
+        if (level == 2) p->l2 = read_list(path, NULL);
+        if (level == 3) p->l3 = read_list(path, NULL);
+    }
+
+    // cpuN/nodeM links to its node, there is none without NUMA
+    p->node = 0;
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d", c);
+    DIR *d = opendir(path);
+    if (!d) return;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        int node;
+        if (sscanf(e->d_name, "node%d", &node) == 1) {
+            p->node = node;
+            break;
+        }
+    }
+    closedir(d);
+}
+
+static void load(void) {
+    if (nusable >= 0) return;
+    nusable = 0;
+    cpu_set_t online, allowed;
+    if (read_list(SYSFS_CPU "/online", &online) < 0) return;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) allowed = online;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (!CPU_ISSET(c, &online) || !CPU_ISSET(c, &allowed)) continue;
+        read_cpu(c);
+        usable[nusable++] = c;
+    }
+}
+
+int topo_cpus(int *out, int max) {
+    load();
+    for (int i = 0; i < nusable && i < max; i++) out[i] = usable[i];
+    return nusable;
+}
+
+int topo_node(int cpu) {
+    load();
+    return cpu >= 0 && cpu < CPU_SETSIZE ? info[cpu].node : 0;
+}
+
+topo_rel_t topo_relation(int a, int b) {
+    load();
+    const struct cpu *x = &info[a], *y = &info[b];
+    if (x->node != y->node) return TOPO_FAR;
+    if (x->core == y->core) return TOPO_SAME_CORE;
+    if (x->l2 >= 0 && x->l2 == y->l2) return TOPO_SHARE_L2;
+    if (x->l3 >= 0 && x->l3 == y->l3) return TOPO_SHARE_L3;
+    return TOPO_SAME_NODE;
+}
+
+const char *topo_relation_name(topo_rel_t rel) {
+    switch (rel) {
+    case TOPO_SHARE_L2: return "cores sharing L2";
+    case TOPO_SHARE_L3: return "cores sharing L3";
+    case TOPO_SAME_CORE: return "SMT siblings";
+    case TOPO_SAME_NODE: return "same node";
+    default: return "different nodes";
+    }
+}
+
+int topo_place_pair(int cpus[2]) {
+    if (mode == PIN_OFF) return 0;
+    load();
+    if (nusable < 2) return 0;
+
+    // this pipeline's node: the next one in turn that has room for both stages
+    int nodes[CPU_SETSIZE], nnodes = 0;
+    for (int i = 0; i < nusable; i++) {
+        int node = info[usable[i]].node, seen = 0, count = 0;
+        for (int k = 0; k < nnodes; k++) seen |= nodes[k] == node;
+        for (int k = 0; k < nusable; k++) count += info[usable[k]].node == node;
+        if (!seen && count >= 2) nodes[nnodes++] = node;
+    }
+    int *list = malloc(nusable * sizeof(int));
+    if (!list) return 0;
+    int n = 0;
+    for (int i = 0; i < nusable; i++) {
+        if (nnodes == 0 || info[usable[i]].node == nodes[placed % nnodes]) list[n++] = usable[i];
+    }
+
+    // rotate where the search starts, so pipelines on one node spread over its cores
+    int start = nnodes ? (int)((placed / nnodes) * 2 % n) : 0;
+    topo_rel_t best = TOPO_FAR;
+    cpus[0] = list[start];
+    cpus[1] = list[(start + 1) % n];
+    for (int i = 0; i < n && best != TOPO_SHARE_L2; i++) {
+        int a = list[(start + i) % n];
+        for (int j = 1; j < n; j++) {
+            int b = list[(start + i + j) % n];
+            topo_rel_t rel = topo_relation(a, b);
+            if (rel < best) {
+                best = rel;
+                cpus[0] = a;
+                cpus[1] = b;
+                if (rel == TOPO_SHARE_L2) break;
+            }
+        }
+    }
+    free(list);
+    placed++;
+    return 1;
+}
+
+int topo_leaf(const char *prog) {
+    static const char *const spawners[] = {
+        "sh", "bash", "dash", "zsh", "ksh", "mksh", "yash", "fish",
+        "xargs", "find", "make", "parallel", "timeout", "watch", NULL
+    };
+    const char *base = strrchr(prog, '/');
+    base = base ? base + 1 : prog;
+    for (int i = 0; spawners[i]; i++) {
+        if (strcmp(base, spawners[i]) == 0) return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,43 @@
+#ifndef TOPO_H
+#define TOPO_H
+
+// CPU placement of pipeline stages, opt-in with "set -o pin=on"
+// the layout is read once from /sys/devices/system/cpu, limited to the CPUs
+// the shell may run on: which CPUs are SMT threads of one core, which share
+// an L2 or L3 cache, and which NUMA node each is on
+// the two stages of a pipeline go on two CPUs as close as possible, so the
+// data in the pipe stays in a shared cache: other cores sharing the L2, then
+// the L3, then SMT siblings, then anything on the same node; successive
+// pipelines take turns across the nodes
+// the mask is set before exec, so everything a pinned stage starts inherits
+// its one CPU: only pipelines of leaf programs are pinned (see topo_leaf)
+
+typedef enum { PIN_OFF, PIN_ON, PIN_VERBOSE } pin_mode_t;
+
+// how close two CPUs are, closest first
+typedef enum { TOPO_SHARE_L2, TOPO_SHARE_L3, TOPO_SAME_CORE, TOPO_SAME_NODE, TOPO_FAR } topo_rel_t;
+
+// "set -o pin=off|on|verbose"; verbose reports every placement on stderr
+void topo_set_mode(pin_mode_t mode);
+pin_mode_t topo_get_mode(void);
+
+// CPUs for the left and right stage of the next pipeline
+// returns 1 with cpus filled, 0 when pinning is off or there are fewer than 2 CPUs
+int topo_place_pair(int cpus[2]);
+
+// 0 if prog is known to run other programs (a shell, xargs, make, ...), whose
+// children would all share the one CPU; 1 otherwise
+int topo_leaf(const char *prog);
+
+// the CPUs placement can use (online and in the shell's affinity mask),
+// filling up to max of them into out; returns how many there are
+int topo_cpus(int *out, int max);
+
+// how close a and b are, and the same as words ("share L2", ...)
+topo_rel_t topo_relation(int a, int b);
+const char *topo_relation_name(topo_rel_t rel);
+
+// NUMA node of cpu (0 without NUMA information)
+int topo_node(int cpu);
+
+#endif /* TOPO_H */
@@ -0,0 +1,214 @@
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+typedef struct var {
+    char *name;
+    char *value;
+    int exported;
+    struct var *next;   // chain within a bucket
+} var_t;
+
+static var_t **buckets = NULL;
+static size_t nbuckets = 0;
+static size_t nvars = 0;
+
+// cached environment for exec, rebuilt lazily
+static char **envp_cache = NULL;
+static int envp_dirty = 1;
+
+static char status_buf[16] = "0";
+static char pid_buf[16];
+
+static uint64_t hash_name(const char *s, size_t len) {
+    uint64_t h = 1469598103934665603ULL; // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static var_t *find(const char *name, size_t len) {
+    if (nbuckets == 0) return NULL;
+    var_t *v = buckets[hash_name(name, len) & (nbuckets - 1)];
+    for (; v; v = v->next) {
+        if (strncmp(v->name, name, len) == 0 && v->name[len] == '\0') return v;
+    }
+    return NULL;
+}
+
+// doubles the table once it is 3/4 full
+static int grow(void) {
+    size_t size = nbuckets ? nbuckets * 2 : 64;
+    var_t **fresh = calloc(size, sizeof(*fresh));
+    if (!fresh) return -1;
+    for (size_t i = 0; i < nbuckets; i++) {
+        var_t *v = buckets[i];
+        while (v) {
+            var_t *next = v->next;
+            size_t b = hash_name(v->name, strlen(v->name)) & (size - 1);
+            v->next = fresh[b];
+            fresh[b] = v;
+            v = next;
+        }
+    }
+    free(buckets);
+    buckets = fresh;
+    nbuckets = size;
+    return 0;
+}
+
+static var_t *find_or_add(const char *name) {
+    size_t len = strlen(name);
+    var_t *v = find(name, len);
+    if (v) return v;
+
+    if ((nvars + 1) * 4 > nbuckets * 3 && grow() < 0) return NULL;
+    v = calloc(1, sizeof(*v));
+    if (!v) return NULL;
+    v->name = strdup(name);
+    v->value = strdup("");
+    if (!v->name || !v->value) {
+        free(v->name);
+        free(v->value);
+        free(v);
+        return NULL;
+    }
+    size_t b = hash_name(name, len) & (nbuckets - 1);
+    v->next = buckets[b];
+    buckets[b] = v;
+    nvars++;
+    return v;
+}
+
+int vars_valid_name(const char *name, int len) {
+    if (len <= 0) return 0;
+    if (!(name[0] == '_' || (name[0] >= 'A' && name[0] <= 'Z') || (name[0] >= 'a' && name[0] <= 'z'))) {
+        return 0;
+    }
+    for (int i = 1; i < len; i++) {
+        char c = name[i];
+        if (!(c == '_' || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void vars_init(char **envp) {
+    snprintf(pid_buf, sizeof(pid_buf), "%d", (int)getpid());
+    for (int i = 0; envp && envp[i]; i++) {
+        const char *eq = strchr(envp[i], '=');
+        if (!eq || !vars_valid_name(envp[i], eq - envp[i])) continue;
+        char *name = strndup(envp[i], eq - envp[i]);
+        if (!name) continue;
+        vars_set(name, eq + 1, 1);
+        free(name);
+    }
+}
+
+const char *vars_get(const char *name) {
+    if (strcmp(name, "?") == 0) return status_buf;
+    if (strcmp(name, "$") == 0) return pid_buf;
+    var_t *v = find(name, strlen(name));
+    return v ? v->value : NULL;
+}
+
+int vars_set(const char *name, const char *value, int export) {
+    if (!vars_valid_name(name, strlen(name))) return -1;
+    char *copy = strdup(value ? value : "");
+    if (!copy) return -1;
+    var_t *v = find_or_add(name);
+    if (!v) {
+        free(copy);
+        return -1;
+    }
+    free(v->value);
+    v->value = copy;
+    if (export) v->exported = 1;
+    if (v->exported) envp_dirty = 1;
+    return 0;
+}
+
+int vars_export(const char *name) {
+    if (!vars_valid_name(name, strlen(name))) return -1;
+    var_t *v = find_or_add(name);
+    if (!v) return -1;
+    if (!v->exported) {
+        v->exported = 1;
+        envp_dirty = 1;
+    }
+    return 0;
+}
+
+int vars_unset(const char *name) {
+    size_t len = strlen(name);
+    if (nbuckets == 0) return 0;
+    var_t **pp = &buckets[hash_name(name, len) & (nbuckets - 1)];
+    for (; *pp; pp = &(*pp)->next) {
+        var_t *v = *pp;
+        if (strcmp(v->name, name) != 0) continue;
+        *pp = v->next;
+        if (v->exported) envp_dirty = 1;
+        free(v->name);
+        free(v->value);
+        free(v);
+        nvars--;
+        return 0;
+    }
+    return 0;
+}
+
+static void free_envp(char **envp) {
+    if (!envp) return;
+    for (int i = 0; envp[i]; i++) free(envp[i]);
+    free(envp);
+}
+
+char **vars_envp(void) {
+    if (!envp_dirty && envp_cache) return envp_cache;
+
+    size_t count = 0;
+    for (size_t i = 0; i < nbuckets; i++) {
+        for (var_t *v = buckets[i]; v; v = v->next) {
+            if (v->exported) count++;
+        }
+    }
+    char **envp = calloc(count + 1, sizeof(char *));
+    if (!envp) return envp_cache; // keep the stale one rather than nothing
+
+    size_t n = 0;
+    for (size_t i = 0; i < nbuckets; i++) {
+        for (var_t *v = buckets[i]; v; v = v->next) {
+            if (!v->exported) continue;
+            size_t len = strlen(v->name) + strlen(v->value) + 2;
+            envp[n] = malloc(len);
+            if (!envp[n]) {
+                free_envp(envp);
+                return envp_cache;
+            }
+            snprintf(envp[n], len, "%s=%s", v->name, v->value);
+            n++;
+        }
+    }
+
+    free_envp(envp_cache);
+    envp_cache = envp;
+    envp_dirty = 0;
+    return envp_cache;
+}
+
+void vars_print_exported(void) {
+    char **envp = vars_envp();
+    for (int i = 0; envp && envp[i]; i++) {
+        printf("export %s\n", envp[i]);
+    }
+}
+
+void vars_set_last_status(int status) {
+    snprintf(status_buf, sizeof(status_buf), "%d", status);
+}
@@ -0,0 +1,37 @@
+#ifndef VARS_H
+#define VARS_H
+
+// shell variables, kept in a hash table
+// exported variables are also handed to every launched command through a
+// cached envp array that is only rebuilt after an exported variable changes
+
+// imports the process environment as exported variables
+void vars_init(char **envp);
+
+// value of name, or NULL if unset ("?" and "$" are the special parameters)
+const char *vars_get(const char *name);
+
+// sets name=value; export 1 marks it exported, 0 keeps its current flag
+// returns 0 on success, -1 on a bad name or allocation failure
+int vars_set(const char *name, const char *value, int export);
+
+// marks name exported (creating it empty if needed)
+int vars_export(const char *name);
+
+// removes name, returns 0 even if it was not set
+int vars_unset(const char *name);
+
+// 1 if name is a valid variable name ([A-Za-z_][A-Za-z0-9_]*)
+int vars_valid_name(const char *name, int len);
+
+// NULL-terminated "NAME=value" array of exported variables, owned by vars.c
+// stays valid until the next change to an exported variable
+char **vars_envp(void);
+
+// prints exported variables as "export NAME=value" lines
+void vars_print_exported(void);
+
+// records the exit status reported by $?
+void vars_set_last_status(int status);
+
+#endif /* VARS_H */
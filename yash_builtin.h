@@ -0,0 +1,37 @@
+#ifndef YASH_BUILTIN_H
+#define YASH_BUILTIN_H
+
+// the interface for builtins loaded at runtime with "enable -f lib.so name"
+//
+// a library exports one descriptor per builtin, named yash_builtin_<name>:
+//
+//     #include "yash_builtin.h"
+//
+//     static int hello(int argc, char **argv) {
+//         printf("hello %s\n", argc > 1 ? argv[1] : "world");
+//         return 0;
+//     }
+//
+//     YASH_BUILTIN(hello) = { YASH_BUILTIN_ABI, "hello", hello, "hello [name]", NULL, NULL };
+//
+// the builtin runs inside the shell process: stdin/stdout/stderr are already
+// redirected when run() is called, stdio output is flushed afterwards, and it
+// must not exit() or leave signal handlers/fds changed behind it
+//
+// this struct only ever grows at the end; fields are never reordered or
+// removed, and a change that old libraries can't work with bumps the ABI number
+
+#define YASH_BUILTIN_ABI 1
+
+struct yash_builtin {
+    unsigned abi;                       // YASH_BUILTIN_ABI the library was built with
+    const char *name;                   // name the builtin is invoked as
+    int (*run)(int argc, char **argv);  // argv[0] is the name, argv[argc] is NULL
+    const char *usage;                  // one line for "enable", may be NULL
+    int (*load)(void);                  // optional, called once; nonzero refuses the load
+    void (*unload)(void);               // optional, called before dlclose
+};
+
+#define YASH_BUILTIN(name) const struct yash_builtin yash_builtin_##name
+
+#endif /* YASH_BUILTIN_H */
@@ -0,0 +1,340 @@
+#define _GNU_SOURCE
+#include "zygote.h"
+#include "exec.h"
+#include "cgroup.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+// biggest request we send in one packet (argv + env + cwd + redirections)
+// anything larger falls back to a normal fork in the shell
+#define ZYG_MSG_MAX (128 * 1024)
+#define ZYG_MAX_FDS 4
+
+extern char **environ;
+
+static int zyg_sock = -1;
+static pid_t zyg_pid = -1;
+
+struct zyg_reply {
+    int32_t pid;
+    int32_t err;
+};
+
+/* ---------- request encoding ---------- */
+
+struct wbuf {
+    char *data;
+    size_t len;
+    int overflow;
+};
+
+static void put_bytes(struct wbuf *b, const void *p, size_t n) {
+    if (b->overflow || b->len + n > ZYG_MSG_MAX) {
+        b->overflow = 1;
+        return;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void put_int(struct wbuf *b, int32_t v) {
+    put_bytes(b, &v, sizeof(v));
+}
+
+static void put_str(struct wbuf *b, const char *s) {
+    put_bytes(b, s, strlen(s) + 1);
+}
+
+struct rbuf {
+    const char *data;
+    size_t len;
+    size_t pos;
+    int bad;
+};
+
+static int32_t get_int(struct rbuf *b) {
+    int32_t v = 0;
+    if (b->bad || b->pos + sizeof(v) > b->len) {
+        b->bad = 1;
+        return 0;
+    }
+    memcpy(&v, b->data + b->pos, sizeof(v));
+    b->pos += sizeof(v);
+    return v;
+}
+
+static char *get_str(struct rbuf *b) {
+    if (b->bad) return NULL;
+    const char *s = b->data + b->pos;
+    const char *nul = memchr(s, '\0', b->len - b->pos);
+    if (!nul) {
+        b->bad = 1;
+        return NULL;
+    }
+    b->pos += (nul - s) + 1;
+    return (char *)s;
+}
+
+// NULL-terminated array of count strings read from b (strings stay in b)
+static char **get_strv(struct rbuf *b, int32_t count) {
+    if (count < 0 || count > ZYG_MSG_MAX) {
+        b->bad = 1;
+        return NULL;
+    }
+    char **v = malloc(sizeof(char *) * (count + 1));
+    if (!v) {
+        b->bad = 1;
+        return NULL;
+    }
+    for (int32_t i = 0; i < count; i++) v[i] = get_str(b);
+    v[count] = NULL;
+    return v;
+}
+
+/* ---------- helper process ---------- */
+
+// like fork(), but the new process becomes a child of our parent (the shell)
+static pid_t clone_parent(void) {
+    return (pid_t)syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, 0);
+}
+
+static void reply(int sock, pid_t pid, int err) {
+    struct zyg_reply r = { pid, err };
+    while (send(sock, &r, sizeof(r), MSG_NOSIGNAL) < 0 && errno == EINTR) {
+        continue;
+    }
+}
+
+// handles one request; the received fds are closed by the caller
+static void serve_one(int sock, const char *msg, size_t len, int *fds, int nfds) {
+    struct rbuf b = { msg, len, 0, 0 };
+    pid_t pgid = get_int(&b);
+    int32_t foreground = get_int(&b);
+    int32_t has_in = get_int(&b);
+    int32_t has_out = get_int(&b);
+    int32_t has_err = get_int(&b);
+    int32_t has_cg = get_int(&b);
+    int32_t cpu = get_int(&b);
+    int32_t argc = get_int(&b);
+    int32_t envc = get_int(&b);
+    int32_t nredirs = get_int(&b);
+    char **argv = get_strv(&b, argc);
+    char **envp = get_strv(&b, envc);
+    char *cwd = get_str(&b);
+
+    struct redir *redirs = NULL;
+    if (!b.bad && nredirs > 0 && nredirs < ZYG_MSG_MAX) {
+        redirs = calloc(nredirs, sizeof(*redirs));
+        if (!redirs) b.bad = 1;
+        for (int32_t i = 0; !b.bad && i < nredirs; i++) {
+            redirs[i].fd = get_int(&b);
+            redirs[i].kind = get_int(&b);
+            redirs[i].target = get_int(&b);
+            char *path = get_str(&b);
+            redirs[i].path = (path && *path) ? path : NULL;
+        }
+    }
+
+    // fds arrive in order: stdin, stdout, stderr, job cgroup (each if present)
+    int in_fd = has_in ? (nfds > 0 ? fds[0] : -1) : -1;
+    int out_fd = has_out ? (nfds > has_in ? fds[has_in] : -1) : -1;
+    int err_fd = has_err ? (nfds > has_in + has_out ? fds[has_in + has_out] : -1) : -1;
+    int cg_at = has_in + has_out + has_err;
+    int cg_fd = has_cg ? (nfds > cg_at ? fds[cg_at] : -1) : -1;
+    if (b.bad || argc < 1 || (has_in && in_fd < 0) || (has_out && out_fd < 0) || (has_err && err_fd < 0) ||
+        (has_cg && cg_fd < 0)) {
+        reply(sock, -1, EINVAL);
+    } else {
+        pid_t pid = cg_fd >= 0 ? cgroup_clone(cg_fd, 1) : clone_parent();
+        if (pid == 0) {
+            close(sock);
+            if (cwd && *cwd && chdir(cwd) < 0) _exit(1);
+            exec_child(argv, envp, redirs, nredirs, pgid, foreground, in_fd, out_fd, err_fd, cpu);
+        }
+        reply(sock, pid, pid < 0 ? errno : 0);
+    }
+
+    free(redirs);
+    free(argv);
+    free(envp);
+}
+
+static void zygote_main(int sock) {
+    static char msg[ZYG_MSG_MAX];
+    char cbuf[CMSG_SPACE(sizeof(int) * ZYG_MAX_FDS)];
+
+    while (1) {
+        struct iovec iov = { msg, sizeof(msg) };
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = cbuf;
+        mh.msg_controllen = sizeof(cbuf);
+
+        ssize_t n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) _exit(0); // the shell is gone
+
+        int fds[ZYG_MAX_FDS];
+        int nfds = 0;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+            int count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (int i = 0; i < count; i++) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+                if (nfds < ZYG_MAX_FDS) {
+                    fds[nfds++] = fd;
+                } else {
+                    close(fd);
+                }
+            }
+        }
+
+        if (mh.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+            reply(sock, -1, EMSGSIZE);
+        } else {
+            serve_one(sock, msg, n, fds, nfds);
+        }
+        for (int i = 0; i < nfds; i++) close(fds[i]);
+    }
+}
+
+/* ---------- shell side ---------- */
+
+int zygote_start(void) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        zygote_main(sv[1]);
+        _exit(0);
+    }
+
+    close(sv[1]);
+    zyg_sock = sv[0];
+    zyg_pid = pid;
+    return 0;
+}
+
+int zygote_active(void) {
+    return zyg_sock >= 0;
+}
+
+pid_t zygote_spawn(const struct zygote_req *req) {
+    if (zyg_sock < 0) {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) cwd[0] = '\0';
+    char **envp = req->envp ? req->envp : environ;
+
+    int32_t argc = 0, envc = 0;
+    while (req->argv[argc]) argc++;
+    while (envp[envc]) envc++;
+
+    static char data[ZYG_MSG_MAX];
+    struct wbuf b = { data, 0, 0 };
+    put_int(&b, req->pgid);
+    put_int(&b, req->foreground);
+    put_int(&b, req->in_fd >= 0);
+    put_int(&b, req->out_fd >= 0);
+    put_int(&b, req->err_fd >= 0);
+    put_int(&b, req->cgroup_fd >= 0);
+    put_int(&b, req->cpu);
+    put_int(&b, argc);
+    put_int(&b, envc);
+    put_int(&b, req->nredirs);
+    for (int i = 0; i < argc; i++) put_str(&b, req->argv[i]);
+    for (int i = 0; i < envc; i++) put_str(&b, envp[i]);
+    put_str(&b, cwd);
+    for (int i = 0; i < req->nredirs; i++) {
+        put_int(&b, req->redirs[i].fd);
+        put_int(&b, req->redirs[i].kind);
+        put_int(&b, req->redirs[i].target);
+        put_str(&b, req->redirs[i].path ? req->redirs[i].path : "");
+    }
+    if (b.overflow) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    int fds[ZYG_MAX_FDS];
+    int nfds = 0;
+    if (req->in_fd >= 0) fds[nfds++] = req->in_fd;
+    if (req->out_fd >= 0) fds[nfds++] = req->out_fd;
+    if (req->err_fd >= 0) fds[nfds++] = req->err_fd;
+    if (req->cgroup_fd >= 0) fds[nfds++] = req->cgroup_fd;
+
+    char cbuf[CMSG_SPACE(sizeof(int) * ZYG_MAX_FDS)];
+    memset(cbuf, 0, sizeof(cbuf));
+    struct iovec iov = { data, b.len };
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    if (nfds > 0) {
+        mh.msg_control = cbuf;
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(c), fds, sizeof(int) * nfds);
+    }
+
+    ssize_t n;
+    while ((n = sendmsg(zyg_sock, &mh, MSG_NOSIGNAL)) < 0 && errno == EINTR) {
+        continue;
+    }
+    if (n < 0) {
+        if (errno == EPIPE) zygote_stop(); // helper died, stop using it
+        return -1;
+    }
+
+    struct zyg_reply r;
+    while ((n = recv(zyg_sock, &r, sizeof(r), 0)) < 0 && errno == EINTR) {
+        continue;
+    }
+    if (n != (ssize_t)sizeof(r)) {
+        zygote_stop();
+        errno = ECHILD;
+        return -1;
+    }
+    if (r.pid < 0) {
+        errno = r.err;
+        return -1;
+    }
+    return r.pid;
+}
+
+void zygote_stop(void) {
+    if (zyg_sock < 0) return;
+    close(zyg_sock);
+    zyg_sock = -1;
+    if (zyg_pid > 0) {
+        waitpid(zyg_pid, NULL, 0);
+        zyg_pid = -1;
+    }
+}
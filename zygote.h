@@ -0,0 +1,36 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <sys/types.h>
+#include "parser.h"
+
+// one launch request for the helper process
+struct zygote_req {
+    char **argv;                // command + args (NULL-terminated)
+    char **envp;                // environment for the new process
+    const struct redir *redirs; // applied in the new process by redir_apply()
+    int nredirs;
+    pid_t pgid;                 // process group to join, 0 = lead a new one
+    int foreground;             // 1 if the new process should take the terminal
+    int in_fd, out_fd, err_fd;  // fds for stdin/stdout/stderr or -1, sent with SCM_RIGHTS
+    int cpu;                    // CPU to pin the new process to (sched_setaffinity), -1 for none
+    int cgroup_fd;              // job cgroup to start in (clone3 CLONE_INTO_CGROUP) or -1, sent the same way
+};
+
+// forks the launcher helper; call at startup, before the shell grows
+// returns 0 on success, -1 if it could not be started
+int zygote_start(void);
+
+// 1 if the helper is running and spawns should go through it
+int zygote_active(void);
+
+// asks the helper to start a process; the helper forks from its own small
+// address space with CLONE_PARENT, so the new process is still our child and
+// waitpid()/job control work exactly as for fork()
+// returns the pid, or -1 (errno set) so the caller can fall back to fork()
+pid_t zygote_spawn(const struct zygote_req *req);
+
+// shuts the helper down (it also exits by itself when the shell goes away)
+void zygote_stop(void);
+
+#endif /* ZYGOTE_H */